@@ -0,0 +1,318 @@
+#include <iostream>
+#include <cstdlib>
+#include <new>
+#include <olc_net.h>
+
+/*
+Microbenchmarks for NetCommon. Every result is printed as one JSON object per
+line, so runs can be stored and diffed to catch regressions:
+
+    NetBench > results.jsonl
+    NetBench serialize tsqueue > results.jsonl      (only some groups)
+
+Groups: serialize, deserialize, copy, tsqueue, broadcast
+Fields: group, name, param, iterations, ns_per_op, ops_per_sec, allocs_per_op
+Always use the Release target, Debug numbers mean nothing
+*/
+
+//Count heap allocations so the small buffer optimisation can be checked
+static std::atomic<uint64_t> g_nAllocations{0};
+
+//Kept out of line - inlined, GCC pairs the free() with the callers' new
+//and reports every pair with -Wmismatched-new-delete
+__attribute__((noinline)) void* operator new(std::size_t n)
+{
+    g_nAllocations.fetch_add(1, std::memory_order_relaxed);
+    if(void* p = std::malloc(n ? n : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+__attribute__((noinline)) void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+enum class BenchMsgTypes : uint32_t
+{
+    FireBullet,
+    MovePlayer,
+    Payload
+};
+
+typedef olc::net::message<BenchMsgTypes> bench_message;
+
+//Keep the optimiser from throwing away the work being measured
+static void Escape(const void* p)
+{
+    asm volatile("" : : "g"(p) : "memory");
+}
+
+template <size_t N>
+struct pod_blob
+{
+    uint8_t data[N];
+};
+
+struct bench_result
+{
+    const char* szGroup;
+    std::string sName;
+    size_t nParam;
+    size_t nIterations;
+    double fNanoseconds;
+    uint64_t nAllocations;
+};
+
+static void Report(const bench_result& r)
+{
+    double fNsPerOp = r.fNanoseconds / double(r.nIterations);
+    std::cout << "{\"group\":\"" << r.szGroup << "\""
+              << ",\"name\":\"" << r.sName << "\""
+              << ",\"param\":" << r.nParam
+              << ",\"iterations\":" << r.nIterations
+              << ",\"ns_per_op\":" << fNsPerOp
+              << ",\"ops_per_sec\":" << (fNsPerOp > 0.0 ? 1e9 / fNsPerOp : 0.0)
+              << ",\"allocs_per_op\":" << double(r.nAllocations) / double(r.nIterations)
+              << "}\n";
+}
+
+//Time nIterations calls of fn, after a short warm up
+template <typename Func>
+static void Run(const char* szGroup, const std::string& sName, size_t nParam, size_t nIterations, Func&& fn)
+{
+    for(size_t i = 0; i < nIterations / 10 + 1; i++)
+        fn();
+
+    uint64_t nAllocStart = g_nAllocations.load();
+    auto tStart = std::chrono::steady_clock::now();
+
+    for(size_t i = 0; i < nIterations; i++)
+        fn();
+
+    auto tEnd = std::chrono::steady_clock::now();
+    uint64_t nAllocEnd = g_nAllocations.load();
+
+    Report({ szGroup, sName, nParam, nIterations,
+             std::chrono::duration<double, std::nano>(tEnd - tStart).count(), nAllocEnd - nAllocStart });
+}
+
+//message<T>::operator<< - one field of N bytes into a fresh message
+template <size_t N>
+static void BenchSerialize()
+{
+    pod_blob<N> blob{};
+    Run("serialize", "push_one", N, 200000, [&]()
+        {
+            bench_message msg;
+            msg.header.id = BenchMsgTypes::Payload;
+            msg << blob;
+            Escape(msg.body.data());
+        });
+}
+
+//message<T>::operator>> and message_view - one field of N bytes back out
+template <size_t N>
+static void BenchDeserialize()
+{
+    pod_blob<N> blob{};
+    bench_message src;
+    src << blob;
+
+    Run("deserialize", "pop_back", N, 200000, [&]()
+        {
+            bench_message msg = src;
+            msg >> blob;
+            Escape(&blob);
+        });
+
+    //Same copy of the message as pop_back, so the difference is the decode
+    Run("deserialize", "view_front", N, 200000, [&]()
+        {
+            bench_message msg = src;
+            olc::net::message_view<BenchMsgTypes> view(msg);
+            view >> blob;
+            Escape(&blob);
+        });
+}
+
+template <size_t N>
+static void BenchCopy()
+{
+    pod_blob<N> blob{};
+    olc::net::owned_message<BenchMsgTypes> src;
+    src.msg << blob;
+
+    Run("copy", "owned_message_copy", N, 200000, [&]()
+        {
+            olc::net::owned_message<BenchMsgTypes> copy = src;
+            Escape(&copy);
+        });
+}
+
+static void BenchSmallMessages()
+{
+    //The common case - FireBullet with two floats, built field by field
+    Run("serialize", "fire_bullet", 8, 500000, []()
+        {
+            bench_message msg;
+            msg.header.id = BenchMsgTypes::FireBullet;
+            msg << 1.0f << 2.0f;
+            Escape(msg.body.data());
+        });
+
+    //A large message built from many small pushes - growth policy
+    Run("serialize", "push_1000_ints", 4000, 5000, []()
+        {
+            bench_message msg;
+            for(int i = 0; i < 1000; i++)
+                msg << i;
+            Escape(msg.body.data());
+        });
+}
+
+//nProducers threads push, the main thread pops until everything arrived
+static void BenchQueue(size_t nProducers)
+{
+    const size_t nPerProducer = 200000;
+    olc::net::tsqueue<bench_message> q;
+    bench_message msg;
+    msg << 1.0f << 2.0f;
+
+    uint64_t nAllocStart = g_nAllocations.load();
+    auto tStart = std::chrono::steady_clock::now();
+
+    std::vector<std::thread> vProducers;
+    for(size_t p = 0; p < nProducers; p++)
+    {
+        vProducers.emplace_back([&]()
+            {
+                for(size_t i = 0; i < nPerProducer; i++)
+                    q.push_back(msg);
+            });
+    }
+
+    size_t nPopped = 0;
+    while(nPopped < nProducers * nPerProducer)
+    {
+        if(!q.empty())
+        {
+            bench_message out = q.pop_front();
+            Escape(&out);
+            nPopped++;
+        }
+    }
+
+    for(auto& t : vProducers)
+        t.join();
+
+    auto tEnd = std::chrono::steady_clock::now();
+    Report({ "tsqueue", "push_pop_producers", nProducers, nPopped,
+             std::chrono::duration<double, std::nano>(tEnd - tStart).count(), g_nAllocations.load() - nAllocStart });
+}
+
+//Server with unconnected but open sockets, enough for MessageAllClients to
+//treat them as live. The context never runs, so only the fan-out is measured
+class BenchServer : public olc::net::server_interface<BenchMsgTypes>
+{
+public:
+    BenchServer() : olc::net::server_interface<BenchMsgTypes>(0)
+    {}
+
+    void AddFakeClients(size_t nClients)
+    {
+        for(size_t i = 0; i < nClients; i++)
+        {
+            auto conn = std::make_shared<olc::net::connection<BenchMsgTypes>>(
+                olc::net::connection<BenchMsgTypes>::owner::server, m_asioContext,
+                asio::ip::tcp::socket(m_asioContext, asio::ip::tcp::v4()), m_qMessagesIn);
+            m_deqConnections.push_back(conn);
+        }
+    }
+};
+
+template <size_t N>
+static void BenchBroadcast(size_t nClients)
+{
+    pod_blob<N> blob{};
+    bench_message msg;
+    msg << blob;
+
+    BenchServer server;
+    server.AddFakeClients(nClients);
+
+    //Reported per client, i.e. the cost of one copy + post
+    uint64_t nAllocStart = g_nAllocations.load();
+    auto tStart = std::chrono::steady_clock::now();
+
+    const size_t nRounds = 50;
+    for(size_t i = 0; i < nRounds; i++)
+        server.MessageAllClients(msg);
+
+    auto tEnd = std::chrono::steady_clock::now();
+    Report({ "broadcast", "message_all_clients_per_client", N, nRounds * nClients,
+             std::chrono::duration<double, std::nano>(tEnd - tStart).count(), g_nAllocations.load() - nAllocStart });
+}
+
+static bool Enabled(int argc, char* argv[], const char* szGroup)
+{
+    if(argc < 2)
+        return true;
+    for(int i = 1; i < argc; i++)
+        if(std::string(argv[i]) == szGroup)
+            return true;
+    return false;
+}
+
+int main(int argc, char* argv[])
+{
+    //Nothing from the library should end up between the JSON lines
+    olc::net::async_logger::Get().SetLevel(olc::net::log_level::none);
+
+    if(Enabled(argc, argv, "serialize"))
+    {
+        BenchSmallMessages();
+        BenchSerialize<4>();
+        BenchSerialize<16>();
+        BenchSerialize<64>();
+        BenchSerialize<256>();
+        BenchSerialize<1024>();
+        BenchSerialize<4096>();
+    }
+
+    if(Enabled(argc, argv, "deserialize"))
+    {
+        BenchDeserialize<4>();
+        BenchDeserialize<64>();
+        BenchDeserialize<1024>();
+        BenchDeserialize<4096>();
+    }
+
+    if(Enabled(argc, argv, "copy"))
+    {
+        BenchCopy<8>();
+        BenchCopy<64>();
+        BenchCopy<1024>();
+    }
+
+    if(Enabled(argc, argv, "tsqueue"))
+    {
+        size_t nMaxProducers = std::max(2u, std::min(8u, std::thread::hardware_concurrency()));
+        for(size_t n = 1; n <= nMaxProducers; n *= 2)
+            BenchQueue(n);
+    }
+
+    if(Enabled(argc, argv, "broadcast"))
+    {
+        BenchBroadcast<8>(64);
+        BenchBroadcast<8>(256);
+        BenchBroadcast<1024>(256);
+    }
+
+    return 0;
+}
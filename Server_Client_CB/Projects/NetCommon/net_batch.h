@@ -0,0 +1,167 @@
+#pragma once
+
+#ifndef NET_BATCH_H_INCLUDED
+#define NET_BATCH_H_INCLUDED
+
+#include "net_common.h"
+#include "net_message.h"
+
+namespace olc
+{
+    namespace net
+    {
+        /*
+        Batch frame - many small messages sharing one message_header on the wire.
+        The top bit of header.size marks the frame, the rest is the body size.
+        Each packed message inside the body is
+
+            <varint id><varint body size><body bytes>
+
+        so a FireBullet with two floats costs 10 bytes instead of 16, and the
+        receiver queues the whole frame with a single lock.
+
+        The next bit marks a control frame - connection housekeeping such as
+        heartbeats (net_clock.h), consumed by the connection and never queued.
+        Its header id is one of control_type
+        */
+        namespace frame
+        {
+            constexpr uint32_t nBatchFlag = 0x80000000u;
+            constexpr uint32_t nControlFlag = 0x40000000u;
+            constexpr uint32_t nSizeMask = 0x3FFFFFFFu;
+
+            //Largest batch body a sender packs, what a schema accepts by default
+            constexpr uint32_t nMaxBatchBodySize = 64 * 1024;
+            //Two varints in front of every packed message, 5 bytes each at most
+            constexpr size_t nMaxPackedOverhead = 10;
+
+            enum class control_type : uint32_t
+            {
+                Heartbeat
+            };
+
+            template <typename T>
+            bool IsBatch(const message_header<T>& header)
+            {
+                return (header.size & nBatchFlag) != 0;
+            }
+
+            template <typename T>
+            bool IsControl(const message_header<T>& header)
+            {
+                return (header.size & nControlFlag) != 0;
+            }
+
+            template <typename T>
+            control_type ControlType(const message_header<T>& header)
+            {
+                return static_cast<control_type>(header.id);
+            }
+
+            //Control frame of the given type carrying data
+            template <typename T, typename DataType>
+            message<T> MakeControl(control_type type, const DataType& data)
+            {
+                message<T> msg;
+                msg.header.id = static_cast<T>(type);
+                msg << data;
+                msg.header.size |= nControlFlag;
+                return msg;
+            }
+
+            //Body bytes that follow a header on the wire, flags stripped
+            template <typename T>
+            uint32_t BodySize(const message_header<T>& header)
+            {
+                return header.size & nSizeMask;
+            }
+
+            inline void PutVarint(message_body& body, uint32_t n)
+            {
+                int8_t buf[5];
+                size_t i = 0;
+                while(n >= 0x80)
+                {
+                    buf[i++] = int8_t(n | 0x80);
+                    n >>= 7;
+                }
+                buf[i++] = int8_t(n);
+
+                size_t nOffset = body.size();
+                body.resize(nOffset + i);
+                std::memcpy(body.data() + nOffset, buf, i);
+            }
+
+            inline bool GetVarint(const int8_t*& p, const int8_t* end, uint32_t& n)
+            {
+                n = 0;
+                for(int shift = 0; shift < 35 && p < end; shift += 7)
+                {
+                    uint8_t b = uint8_t(*p++);
+                    n |= uint32_t(b & 0x7F) << shift;
+                    if(!(b & 0x80))
+                        return true;
+                }
+                return false;
+            }
+
+            //A body of 2^30 bytes or more would spill into the frame flag bits
+            template <typename T>
+            bool FitsFrame(const message<T>& msg)
+            {
+                return msg.body.size() <= nSizeMask && (msg.header.size & ~nSizeMask) == 0;
+            }
+
+            //Bytes msg adds to a batch body at most
+            template <typename T>
+            size_t PackedSize(const message<T>& msg)
+            {
+                return nMaxPackedOverhead + msg.body.size();
+            }
+
+            //Append msg to a batch frame, the frame header is kept up to date
+            template <typename T>
+            void Append(message<T>& batch, const message<T>& msg)
+            {
+                PutVarint(batch.body, static_cast<uint32_t>(msg.header.id));
+                PutVarint(batch.body, uint32_t(msg.body.size()));
+
+                size_t nOffset = batch.body.size();
+                batch.body.resize(nOffset + msg.body.size());
+                if(!msg.body.empty())
+                    std::memcpy(batch.body.data() + nOffset, msg.body.data(), msg.body.size());
+
+                batch.header.size = nBatchFlag | uint32_t(batch.body.size());
+            }
+
+            //Call fn(message<T>&&) for every message packed in the batch body.
+            //Returns false on a malformed frame, messages before it were delivered
+            template <typename T, typename Func>
+            bool Unpack(const message<T>& batch, Func&& fn)
+            {
+                const int8_t* p = batch.body.data();
+                const int8_t* end = p + batch.body.size();
+
+                while(p < end)
+                {
+                    uint32_t nID, nSize;
+                    if(!GetVarint(p, end, nID) || !GetVarint(p, end, nSize))
+                        return false;
+                    if(size_t(end - p) < nSize)
+                        return false;
+
+                    message<T> msg;
+                    msg.header.id = static_cast<T>(nID);
+                    msg.header.size = nSize;
+                    msg.body.assign(p, nSize);
+                    p += nSize;
+
+                    fn(std::move(msg));
+                }
+                return true;
+            }
+        }
+    }
+}
+
+#endif // NET_BATCH_H_INCLUDED
@@ -10,51 +10,86 @@ namespace olc
 {
     namespace net
     {
+        /*
+        Example - no more polling Incoming()
+        client.SetMessageHandler([](olc::net::message<CustomMsgTypes>& msg) { ... });
+
+        //... or on a strand of your own, handlers never overlap
+        client.SetMessageHandler(handler, asio::make_strand(client.Context()));
+
+        //... or on the game thread, woken up as soon as something arrives
+        client.SetMessageHandler(handler, olc::net::dispatch_mode::user_thread);
+        while(bRunning)
+        {
+            client.WaitForMessages(std::chrono::milliseconds(16));
+            client.DispatchMessages();
+        }
+        */
+
+        //Where a handler set without an executor runs
+        enum class dispatch_mode
+        {
+            //On the client's asio thread, as soon as a message is complete.
+            //Keep it short, no reads are done while it runs
+            io_thread,
+            //Only inside DispatchMessages(), called from a thread of your own
+            user_thread
+        };
+
         //Incharge of setting up asio and connection
         //Access point for server
-        template<typename T>
+        //Protocol is the asio stream protocol to connect with, TCP unless stated otherwise
+        template<typename T, typename Protocol = asio::ip::tcp>
         class client_interface
         {
         public:
+            typedef std::function<void(message<T>&)> message_handler;
+
             client_interface() : m_socket(m_context)
             {
                 //Initialize the socket with io context
+
+                //Connection pushes from the asio thread, hand the messages on from there
+                m_qMessageIn.set_notifier([this]() { OnIncoming(); });
             }
             virtual ~client_interface()
             {
+                //No handler may start once the members start going away
+                ClearMessageHandler();
+
                 //If client is destroyed, always try and disconnect from server
                 Disconnect();
             }
         public:
-            //Connect to server with hostname/ip-address and port
+            //Connect to server with hostname/ip-address and port (TCP only)
             bool Connect(const std::string& host, const uint16_t port)
             {
                 try
                 {
-
                     //Resolve hostname/ip-address into tangible physical address
                     asio::ip::tcp::resolver resolver(m_context);
                     asio::ip::tcp::resolver::results_type endpoints = resolver.resolve(host, std::to_string(port));
 
-                    //Create connection
-                    m_connection = std::make_unique<connection<T>>(
-                        connection<T>::owner::client,
-                        m_context,
-                        asio::ip::tcp::socket(m_context), m_qMessageIn);
-
-
-
-                    m_connection->ConnectToServer(endpoints);
-
-                    //Start Context Thread
-                    ctxThread = std::thread([this](){ m_context.run();});
+                    return ConnectToEndpoints(endpoints);
                 }
                 catch (std::exception& e)
                 {
                     std::cerr << "Client exception: " << e.what() << "\n";
                     return false;
                 }
-                return true;
+            }
+
+            //Connect to a known endpoint, e.g. the socket path of a server
+            //listening on asio::local::stream_protocol
+            bool Connect(const typename Protocol::endpoint& endpoint)
+            {
+                return ConnectToEndpoints(std::vector<typename Protocol::endpoint>{ endpoint });
+            }
+
+            //Socket tuning used by the next Connect()
+            void SetSocketOptions(const socket_options& opts)
+            {
+                m_socketOptions = opts;
             }
 
             //Disconnect from server
@@ -67,15 +102,19 @@ namespace olc
                     m_connection->Disconnect();
                 }
 
-                //Stop the context
-                m_context.stop();
+                //Stop the context, behind the close posted above so it still runs
+                if(ctxThread.joinable())
+                    asio::post(m_context, [this]() { m_context.stop(); });
+                else
+                    m_context.stop();
 
                 //And the context thread
                 if(ctxThread.joinable())
                     ctxThread.join();
 
-                //Release pointer
-                m_connection.release();
+                //Destroy the connection while the context it belongs to is alive. Handlers
+                //still queued hold it too, the context releases those when it goes
+                m_connection.reset();
             }
 
             //Get connection status
@@ -87,23 +126,172 @@ namespace olc
                     return false;
             }
 
-            tsqueue<owned_message<T>>&  Incoming()
+            //Round trip and server clock offset, valid once heartbeats went both ways
+            link_timing Timing()
+            {
+                if(m_connection)
+                    return m_connection->Timing();
+                return link_timing();
+            }
+
+            tsqueue<owned_message<T, Protocol>>&  Incoming()
             {
                 return m_qMessageIn;
             }
+
+            //Context of the connection, e.g. to make a strand for SetMessageHandler
+            asio::io_context& Context()
+            {
+                return m_context;
+            }
+
+            //Call handler for every incoming message instead of queuing it for
+            //Incoming(). Messages that arrived before are handed over first
+            void SetMessageHandler(message_handler handler, dispatch_mode mode = dispatch_mode::io_thread)
+            {
+                auto binding = std::make_shared<handler_binding>();
+                binding->fnHandler = std::move(handler);
+                if(mode == dispatch_mode::io_thread)
+                    binding->fnSchedule = [this]() { DispatchMessages(); };
+
+                Bind(std::move(binding), mode == dispatch_mode::io_thread);
+            }
+
+            //Call handler on executor - a strand, a thread pool, an io_context of
+            //the game loop. Arrivals are coalesced into one post while one is
+            //pending, so a multi threaded executor needs a strand to keep order
+            template<typename Executor>
+            void SetMessageHandler(message_handler handler, const Executor& executor)
+            {
+                auto binding = std::make_shared<handler_binding>();
+                binding->fnHandler = std::move(handler);
+
+                std::weak_ptr<handler_binding> weak = binding;
+                binding->fnSchedule = [this, executor, weak]()
+                {
+                    auto self = weak.lock();
+                    if(!self || self->bPosted.exchange(true))
+                        return;
+
+                    asio::post(executor, [this, weak]()
+                        {
+                            //Replaced or cleared while the post was queued
+                            auto self = weak.lock();
+                            if(!self || std::atomic_load(&m_pBinding) != self)
+                                return;
+
+                            self->bPosted = false;
+                            DispatchMessages();
+                        });
+                };
+
+                Bind(std::move(binding), true);
+            }
+
+            //Back to polling Incoming()
+            void ClearMessageHandler()
+            {
+                std::atomic_store(&m_pBinding, std::shared_ptr<handler_binding>());
+            }
+
+            //Run the handler for up to nMaxMessages queued messages, on the
+            //calling thread. Returns how many were handled
+            size_t DispatchMessages(size_t nMaxMessages = -1)
+            {
+                auto binding = std::atomic_load(&m_pBinding);
+                if(!binding)
+                    return 0;
+
+                size_t nMessageCount = 0;
+                while(nMessageCount < nMaxMessages && !m_qMessageIn.empty())
+                {
+                    auto msg = m_qMessageIn.pop_front();
+                    binding->fnHandler(msg.msg);
+                    nMessageCount++;
+                }
+                return nMessageCount;
+            }
+
+            //Sleep until a message arrives or the timeout passes, returns false on timeout
+            bool WaitForMessages(std::chrono::milliseconds timeout)
+            {
+                return m_qMessageIn.wait_for(timeout);
+            }
+
+        private:
+            //A handler and how to get it called, swapped as a whole so the
+            //asio thread never sees half of a new one
+            struct handler_binding
+            {
+                message_handler fnHandler;
+                //Empty - nothing to schedule, the user thread dispatches
+                std::function<void()> fnSchedule;
+                //A dispatch is already posted to the executor
+                std::atomic<bool> bPosted{false};
+            };
+
+            void Bind(std::shared_ptr<handler_binding> binding, bool bScheduleBacklog)
+            {
+                std::atomic_store(&m_pBinding, binding);
+
+                //Messages queued before the handler was set would otherwise wait
+                //for the next arrival. The asio thread runs io_thread handlers
+                if(bScheduleBacklog && !m_qMessageIn.empty())
+                    asio::post(m_context, [this]() { OnIncoming(); });
+            }
+
+            //asio thread, after the connection queued one or more messages
+            void OnIncoming()
+            {
+                auto binding = std::atomic_load(&m_pBinding);
+                if(binding && binding->fnSchedule)
+                    binding->fnSchedule();
+            }
+
+            template<typename EndpointSequence>
+            bool ConnectToEndpoints(const EndpointSequence& endpoints)
+            {
+                try
+                {
+                    //Create connection
+                    m_connection = std::make_shared<connection<T, Protocol>>(
+                        connection<T, Protocol>::owner::client,
+                        m_context,
+                        typename Protocol::socket(m_context), m_qMessageIn, m_socketOptions);
+                    m_connection->SetRemoteTagged(false);
+
+                    m_connection->ConnectToServer(endpoints);
+
+                    //Start Context Thread
+                    ctxThread = std::thread([this](){ m_context.run();});
+                }
+                catch (std::exception& e)
+                {
+                    std::cerr << "Client exception: " << e.what() << "\n";
+                    return false;
+                }
+                return true;
+            }
+
         protected:
             //Handles the asio, data transfer
             asio::io_context m_context;
             //... requires a thread to loop and keep running
             std::thread ctxThread;
             //Hardware socket connected to the server
-            asio::ip::tcp::socket m_socket;
+            typename Protocol::socket m_socket;
             //Connection object that handles the data transfer
-            std::unique_ptr<connection<T>> m_connection;
+            //Shared with its pending handlers, see connection
+            std::shared_ptr<connection<T, Protocol>> m_connection;
+            //Applied to the socket once connected
+            socket_options m_socketOptions;
 
 
         private:
-            tsqueue<owned_message<T>> m_qMessageIn;
+            tsqueue<owned_message<T, Protocol>> m_qMessageIn;
+
+            //Set by SetMessageHandler, read by the asio thread
+            std::shared_ptr<handler_binding> m_pBinding;
 
         };
     }
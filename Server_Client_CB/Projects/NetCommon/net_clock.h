@@ -0,0 +1,165 @@
+#pragma once
+
+#ifndef NET_CLOCK_H_INCLUDED
+#define NET_CLOCK_H_INCLUDED
+
+#include "net_common.h"
+
+#include <array>
+#include <cmath>
+
+namespace olc
+{
+    namespace net
+    {
+        /*
+        Example
+        //Both sides send a heartbeat every second
+        opts.nHeartbeatMilliseconds = 1000;
+
+        //Any thread, per connection
+        olc::net::link_timing timing = client->Timing();
+        if(timing.Valid())
+        {
+            //Lag compensation - rewind the world by half a round trip
+            auto tRewind = timing.rtt / 2;
+
+            //Server time of a client timestamp
+            int64_t tServer = tClient + timing.clockOffset.count();
+        }
+        */
+
+        //Microseconds on the wall clock, the only clock two processes share
+        inline int64_t WallClockMicros()
+        {
+            return std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+        }
+
+        //Body of a heartbeat control frame. Each side echoes the last heartbeat it
+        //got from the other, so both ends measure the round trip without an extra
+        //request/response. All times in microseconds of the sender's wall clock
+        struct heartbeat
+        {
+            //When this heartbeat was sent
+            int64_t tSend;
+            //tSend of the last heartbeat received from the peer, 0 if none yet
+            int64_t tEcho;
+            //How long that heartbeat waited here before this one was sent
+            int64_t tHeld;
+        };
+
+        //Snapshot of what a connection knows about its link
+        struct link_timing
+        {
+            //Smoothed round trip time and its mean deviation (jitter), RFC 6298
+            std::chrono::microseconds rtt{0};
+            std::chrono::microseconds rttVariance{0};
+            //Lowest round trip seen, the path without queueing
+            std::chrono::microseconds rttMin{0};
+            //Peer clock minus local clock
+            std::chrono::microseconds clockOffset{0};
+            //Round trips measured so far
+            uint64_t nSamples = 0;
+
+            bool Valid() const
+            {
+                return nSamples > 0;
+            }
+        };
+
+        //Turns heartbeats into round trip and clock offset estimates. Written by
+        //the asio thread, Timing() may be called from anywhere
+        class clock_estimator
+        {
+        public:
+            //Fill in the heartbeat about to be sent at tNow
+            heartbeat MakeHeartbeat(int64_t tNow)
+            {
+                std::scoped_lock lock(m_mux);
+                heartbeat hb;
+                hb.tSend = tNow;
+                hb.tEcho = m_tPeerSend;
+                hb.tHeld = m_tPeerSend != 0 ? tNow - m_tPeerReceived : 0;
+                return hb;
+            }
+
+            //A heartbeat from the peer arrived at local time tReceived
+            void OnHeartbeat(const heartbeat& hb, int64_t tReceived)
+            {
+                std::scoped_lock lock(m_mux);
+                m_tPeerSend = hb.tSend;
+                m_tPeerReceived = tReceived;
+
+                if(hb.tEcho == 0)
+                    return;
+
+                //NTP - t1 our send, t2 peer receive, t3 peer send, t4 our receive
+                int64_t t1 = hb.tEcho;
+                int64_t t2 = hb.tSend - hb.tHeld;
+                int64_t t3 = hb.tSend;
+                int64_t t4 = tReceived;
+
+                int64_t nRtt = (t4 - t1) - (t3 - t2);
+                //Wall clock stepped, or a bogus peer
+                if(nRtt < 0 || hb.tHeld < 0)
+                    return;
+
+                int64_t nOffset = ((t2 - t1) + (t3 - t4)) / 2;
+
+                if(m_timing.nSamples == 0)
+                {
+                    m_fSrtt = double(nRtt);
+                    m_fRttVar = double(nRtt) / 2.0;
+                    m_timing.rttMin = std::chrono::microseconds(nRtt);
+                }
+                else
+                {
+                    m_fRttVar = 0.75 * m_fRttVar + 0.25 * std::abs(m_fSrtt - double(nRtt));
+                    m_fSrtt = 0.875 * m_fSrtt + 0.125 * double(nRtt);
+                    m_timing.rttMin = std::min(m_timing.rttMin, std::chrono::microseconds(nRtt));
+                }
+
+                //The offset of a fast round trip is the most accurate, queueing
+                //delay is rarely the same both ways. Use the fastest of the window
+                m_aSamples[m_timing.nSamples % m_aSamples.size()] = { nRtt, nOffset };
+                m_timing.nSamples++;
+
+                size_t nValid = std::min<size_t>(m_timing.nSamples, m_aSamples.size());
+                auto best = std::min_element(m_aSamples.begin(), m_aSamples.begin() + nValid,
+                    [](const sample& a, const sample& b) { return a.nRtt < b.nRtt; });
+
+                m_timing.rtt = std::chrono::microseconds(int64_t(m_fSrtt));
+                m_timing.rttVariance = std::chrono::microseconds(int64_t(m_fRttVar));
+                m_timing.clockOffset = std::chrono::microseconds(best->nOffset);
+            }
+
+            link_timing Timing() const
+            {
+                std::scoped_lock lock(m_mux);
+                return m_timing;
+            }
+
+        private:
+            struct sample
+            {
+                int64_t nRtt;
+                int64_t nOffset;
+            };
+
+            mutable std::mutex m_mux;
+
+            //Last heartbeat from the peer, echoed in the next one we send
+            int64_t m_tPeerSend = 0;
+            int64_t m_tPeerReceived = 0;
+
+            double m_fSrtt = 0.0;
+            double m_fRttVar = 0.0;
+            std::array<sample, 8> m_aSamples{};
+
+            link_timing m_timing;
+        };
+    }
+}
+
+#endif // NET_CLOCK_H_INCLUDED
@@ -0,0 +1,670 @@
+#pragma once
+
+#ifndef NET_CLUSTER_H_INCLUDED
+#define NET_CLUSTER_H_INCLUDED
+
+#include "net_common.h"
+#include "net_server.h"
+
+#include <unordered_map>
+#include <stdexcept>
+
+namespace olc
+{
+    namespace net
+    {
+        /*
+        Example - two nodes on one host
+        class GameNode : public olc::net::cluster_server<CustomMsgTypes>
+        {
+        public:
+            GameNode(uint32_t nNode, uint16_t nPort, uint16_t nRelayPort)
+                : olc::net::cluster_server<CustomMsgTypes>(nNode, nPort, nRelayPort) {}
+            ...
+        };
+
+        GameNode node(1, 60000, 61000);     //node 1, clients on 60000, other nodes on 61000
+        node.SetClusterSecret(sSharedSecret);
+        node.AddPeer(2, "127.0.0.1", 61001);
+        node.Start();
+
+        //Nodes on other hosts - the relay port listens on loopback unless told otherwise
+        node.SetRelayAddress(asio::ip::make_address("10.0.0.1"));
+
+        //Wherever in the cluster the client is connected
+        MessageClientByID(nClientID, msg);
+
+        //Every client of every node, one relay message per node
+        MessageCluster(msg);
+        */
+
+        //Pushed onto the end of every message on a relay link and popped off
+        //again by the receiving node, so user messages travel unchanged
+        enum class relay_op : uint32_t
+        {
+            //<secret><secret length><node id> - first message each way on a new
+            //link. Only the dialing node sends the secret
+            Hello,
+            //<client ids><count> - clients that connected to the sender
+            Joined,
+            //<client ids><count> - clients that left the sender
+            Left,
+            //<user message><client id> - deliver to one local client
+            Forward,
+            //<user message> - deliver to every local client
+            Broadcast
+        };
+
+        //A server_interface that is one node of a cluster. Nodes keep a TCP
+        //relay link to every peer, tell each other which clients they own and
+        //route MessageClientByID / MessageCluster over those links. Relay
+        //traffic is handled in Update() / Tick(), on the thread running them
+        template<typename T, typename Protocol = asio::ip::tcp>
+        class cluster_server : public server_interface<T, Protocol>
+        {
+        public:
+            typedef connection<T, asio::ip::tcp> relay_connection;
+
+            //nNodeID 1..255 - also the top byte of every client ID the node hands
+            //out, so IDs never collide across the cluster. Throws std::invalid_argument
+            //outside that range, 0 means "no node" in the directory
+            cluster_server(uint32_t nNodeID, uint16_t nClientPort, uint16_t nRelayPort)
+                : server_interface<T, Protocol>(nClientPort), m_nNodeID(CheckedNodeID(nNodeID)),
+                  m_relayAcceptor(this->m_asioContext), m_relayEndpoint(asio::ip::address_v4::loopback(), nRelayPort)
+            {
+                this->nIDCounter = (nNodeID << 24) + 10000;
+            }
+
+            cluster_server(uint32_t nNodeID, const typename Protocol::endpoint& endpoint, uint16_t nRelayPort)
+                : server_interface<T, Protocol>(endpoint), m_nNodeID(CheckedNodeID(nNodeID)),
+                  m_relayAcceptor(this->m_asioContext), m_relayEndpoint(asio::ip::address_v4::loopback(), nRelayPort)
+            {
+                this->nIDCounter = (nNodeID << 24) + 10000;
+            }
+
+            virtual ~cluster_server()
+            {
+                this->Stop();
+
+                //Relay links own sockets of the base's context, release them while it is alive
+                m_mapNodes.clear();
+                m_mapLocal.clear();
+                m_vPeers.clear();
+                m_vLinks.clear();
+                m_deqDeadLinks.clear();
+                m_qAcceptedLinks.clear();
+                m_qResolvedPeers.clear();
+                m_qRelayIn.clear();
+            }
+
+        public:
+            //Another node of the cluster. Configure every node with all the others,
+            //of each pair the one with the lower ID dials and keeps redialing
+            void AddPeer(uint32_t nNodeID, const std::string& host, uint16_t nRelayPort)
+            {
+                if(!ValidNodeID(nNodeID) || nNodeID == m_nNodeID)
+                {
+                    Log(log_level::error, "Invalid Cluster Peer", nNodeID);
+                    return;
+                }
+
+                m_vPeers.push_back({ nNodeID, host, nRelayPort, nullptr, std::chrono::steady_clock::time_point(), false });
+            }
+
+            //Interface the relay port listens on, loopback by default. Call before Start()
+            void SetRelayAddress(const asio::ip::address& address)
+            {
+                m_relayEndpoint.address(address);
+            }
+
+            //Every node of the cluster must be given the same secret, a node dialing
+            //in without it is dropped. Required when the relay port is off loopback
+            void SetClusterSecret(const std::string& sSecret)
+            {
+                m_sSecret = sSecret;
+            }
+
+            //Opens the relay port as well, links to peers are made from Update()
+            bool Start()
+            {
+                if(m_sSecret.empty() && !m_relayEndpoint.address().is_loopback())
+                {
+                    std::cerr << "[CLUSTER] relay port off loopback without a cluster secret\n";
+                    return false;
+                }
+
+                try
+                {
+                    m_relayAcceptor.open(m_relayEndpoint.protocol());
+                    m_relayAcceptor.set_option(asio::socket_base::reuse_address(true));
+                    m_relayAcceptor.bind(m_relayEndpoint);
+                    m_relayAcceptor.listen();
+                }
+                catch(std::exception& e)
+                {
+                    std::cerr << "[CLUSTER] exception: " << e.what() << "\n";
+                    return false;
+                }
+
+                WaitForRelayConnection();
+
+                return server_interface<T, Protocol>::Start();
+            }
+
+            //Send message to a client wherever in the cluster it is connected.
+            //Returns false if no linked node is known to own it
+            bool MessageClientByID(uint32_t nClientID, const message<T>& msg)
+            {
+                if(auto client = FindLocalClient(nClientID))
+                {
+                    this->MessageClient(client, msg);
+                    return true;
+                }
+
+                auto owner = m_mapDirectory.find(nClientID);
+                if(owner == m_mapDirectory.end())
+                    return false;
+
+                auto node = m_mapNodes.find(owner->second);
+                if(node == m_mapNodes.end() || !node->second->IsConnected())
+                    return false;
+
+                message<T> relay = msg;
+                relay << nClientID << uint32_t(relay_op::Forward);
+                node->second->Send(std::move(relay));
+                return true;
+            }
+
+            //Send message to every client of every node. Each node gets it once
+            //and fans it out to its own clients
+            void MessageCluster(const message<T>& msg, std::shared_ptr<connection<T, Protocol>> pIgnoreClient = nullptr)
+            {
+                this->MessageAllClients(msg, pIgnoreClient);
+
+                if(m_mapNodes.empty())
+                    return;
+
+                message<T> relay = msg;
+                relay << uint32_t(relay_op::Broadcast);
+                for(auto& node : m_mapNodes)
+                {
+                    if(node.second->IsConnected())
+                        node.second->Send(relay);
+                }
+            }
+
+            //Node the client is connected to, 0 if unknown
+            uint32_t FindClientNode(uint32_t nClientID)
+            {
+                if(FindLocalClient(nClientID))
+                    return m_nNodeID;
+
+                auto owner = m_mapDirectory.find(nClientID);
+                return owner != m_mapDirectory.end() ? owner->second : 0;
+            }
+
+            uint32_t NodeID() const
+            {
+                return m_nNodeID;
+            }
+
+            //Peers with a live relay link
+            size_t LinkedNodeCount() const
+            {
+                return m_mapNodes.size();
+            }
+
+        protected:
+            //Relay housekeeping, call it when overriding OnUpdate further down
+            void OnUpdate() override
+            {
+                while(!m_qAcceptedLinks.empty())
+                    m_vLinks.push_back({ m_qAcceptedLinks.pop_front(), 0, false });
+
+                PruneLinks();
+                DialPeers();
+                ProcessRelayMessages();
+                SyncLocalClients();
+            }
+
+        private:
+            struct relay_link
+            {
+                std::shared_ptr<relay_connection> conn;
+                //0 until the Hello arrived
+                uint32_t nNodeID;
+                //We dialed it, as opposed to accepted it
+                bool bOutbound;
+            };
+
+            struct relay_peer
+            {
+                uint32_t nNodeID;
+                std::string sHost;
+                uint16_t nPort;
+                std::shared_ptr<relay_connection> conn;
+                std::chrono::steady_clock::time_point tLastDial;
+                //A lookup of sHost is in flight
+                bool bResolving;
+            };
+
+            struct resolved_peer
+            {
+                uint32_t nNodeID;
+                std::error_code ec;
+                asio::ip::tcp::resolver::results_type endpoints;
+            };
+
+            //ASYNC - accept links dialed by other nodes
+            void WaitForRelayConnection()
+            {
+                m_relayAcceptor.async_accept(
+                    [this](std::error_code ec, asio::ip::tcp::socket socket)
+                    {
+                        if(!m_relayAcceptor.is_open())
+                            return;
+
+                        if(!ec)
+                        {
+                            ApplySocketOptions(socket, this->m_socketOptions);
+
+                            auto link = std::make_shared<relay_connection>(relay_connection::owner::server,
+                                this->m_asioContext, std::move(socket), m_qRelayIn, this->m_socketOptions);
+                            //Relay trailers would break the schema of T
+                            link->SetSchemaChecked(false);
+                            link->ConnectToClient(0);
+
+                            //The dialing node answers with its own Hello and the secret
+                            link->Send(MakeHello(false));
+                            m_qAcceptedLinks.push_back(std::move(link));
+                        }
+                        else
+                        {
+                            Log(log_level::error, "Relay Accept Failed", 0, ec);
+                        }
+
+                        WaitForRelayConnection();
+                    });
+            }
+
+            //Names are looked up on the asio thread, a slow or dead name server
+            //never holds up Update(). The link is made here once the answer is back
+            void DialPeers()
+            {
+                while(!m_qResolvedPeers.empty())
+                {
+                    auto resolved = m_qResolvedPeers.pop_front();
+                    auto peer = std::find_if(m_vPeers.begin(), m_vPeers.end(),
+                        [&](const relay_peer& p) { return p.nNodeID == resolved.nNodeID; });
+                    if(peer == m_vPeers.end())
+                        continue;
+
+                    peer->bResolving = false;
+                    if(resolved.ec)
+                    {
+                        Log(log_level::warning, "Relay Resolve Failed", peer->nNodeID, resolved.ec);
+                        continue;
+                    }
+
+                    try
+                    {
+                        peer->conn = std::make_shared<relay_connection>(relay_connection::owner::client,
+                            this->m_asioContext, asio::ip::tcp::socket(this->m_asioContext), m_qRelayIn, this->m_socketOptions);
+                        peer->conn->SetSchemaChecked(false);
+                        peer->conn->ConnectToServer(resolved.endpoints);
+                        m_vLinks.push_back({ peer->conn, 0, true });
+                    }
+                    catch(std::exception& e)
+                    {
+                        Log(log_level::warning, "Relay Dial Failed", peer->nNodeID, std::error_code(), e.what());
+                    }
+                }
+
+                auto tNow = std::chrono::steady_clock::now();
+                for(auto& peer : m_vPeers)
+                {
+                    //Only the lower ID dials, a pair of nodes never ends up with two links
+                    if(peer.nNodeID <= m_nNodeID || peer.bResolving)
+                        continue;
+                    if(peer.conn && peer.conn->IsConnected())
+                        continue;
+                    if(tNow - peer.tLastDial < tRedialInterval)
+                        continue;
+
+                    peer.tLastDial = tNow;
+                    peer.bResolving = true;
+
+                    auto resolver = std::make_shared<asio::ip::tcp::resolver>(this->m_asioContext);
+                    resolver->async_resolve(peer.sHost, std::to_string(peer.nPort),
+                        [this, resolver, nNodeID = peer.nNodeID](std::error_code ec,
+                            asio::ip::tcp::resolver::results_type endpoints)
+                        {
+                            m_qResolvedPeers.push_back({ nNodeID, ec, std::move(endpoints) });
+                        });
+                }
+            }
+
+            //Closed links are dropped from the directory. The objects are kept a
+            //little longer, the asio thread may still run handlers for them
+            void PruneLinks()
+            {
+                auto tNow = std::chrono::steady_clock::now();
+
+                for(auto it = m_vLinks.begin(); it != m_vLinks.end();)
+                {
+                    if(it->conn->IsConnected())
+                    {
+                        ++it;
+                        continue;
+                    }
+
+                    auto node = m_mapNodes.find(it->nNodeID);
+                    if(node != m_mapNodes.end() && node->second == it->conn)
+                    {
+                        m_mapNodes.erase(node);
+                        ForgetNode(it->nNodeID);
+                        Log(log_level::warning, "Cluster Node Lost", it->nNodeID);
+                    }
+
+                    m_deqDeadLinks.push_back({ tNow, std::move(it->conn) });
+                    it = m_vLinks.erase(it);
+                }
+
+                while(!m_deqDeadLinks.empty() && tNow - m_deqDeadLinks.front().first > tDeadLinkGrace)
+                    m_deqDeadLinks.pop_front();
+            }
+
+            void ProcessRelayMessages()
+            {
+                while(!m_qRelayIn.empty())
+                {
+                    auto relay = m_qRelayIn.pop_front();
+                    auto& msg = relay.msg;
+
+                    auto link = std::find_if(m_vLinks.begin(), m_vLinks.end(),
+                        [&](const relay_link& l) { return l.conn == relay.remote; });
+                    if(link == m_vLinks.end())
+                        continue;
+
+                    uint32_t nOp = 0;
+                    if(!PopTrailer(msg, nOp))
+                    {
+                        Log(log_level::warning, "Malformed Relay Message", link->nNodeID);
+                        continue;
+                    }
+
+                    //Only a Hello is taken from a node that has not said who it is
+                    if(link->nNodeID == 0 && relay_op(nOp) != relay_op::Hello)
+                        continue;
+
+                    switch(relay_op(nOp))
+                    {
+                    case relay_op::Hello:
+                        OnRelayHello(*link, msg);
+                        break;
+
+                    case relay_op::Joined:
+                    case relay_op::Left:
+                        OnRelayDirectory(*link, msg, relay_op(nOp) == relay_op::Joined);
+                        break;
+
+                    case relay_op::Forward:
+                    {
+                        uint32_t nClientID = 0;
+                        if(!PopTrailer(msg, nClientID))
+                            break;
+
+                        //Not re-forwarded if the client moved on, links would loop
+                        if(auto client = FindLocalClient(nClientID))
+                            this->MessageClient(client, std::move(msg));
+                        break;
+                    }
+
+                    case relay_op::Broadcast:
+                        this->MessageAllClients(msg);
+                        break;
+
+                    default:
+                        Log(log_level::warning, "Unknown Relay Message", link->nNodeID);
+                        break;
+                    }
+                }
+            }
+
+            void OnRelayHello(relay_link& link, message<T>& msg)
+            {
+                uint32_t nNodeID = 0, nSecretLength = 0;
+                bool bValid = PopTrailer(msg, nNodeID) && PopTrailer(msg, nSecretLength) &&
+                              msg.body.size() == nSecretLength && ValidNodeID(nNodeID) && nNodeID != m_nNodeID;
+
+                //The accepting side checks the secret. It never sends its own, anyone
+                //can connect to the relay port and would be handed it
+                if(!bValid || (!link.bOutbound && !SecretMatches(msg)))
+                {
+                    Log(log_level::error, "Relay Hello Rejected", nNodeID);
+                    link.conn->Disconnect();
+                    return;
+                }
+
+                link.nNodeID = nNodeID;
+
+                //Accepting side spoke first, answer it
+                if(link.bOutbound)
+                    link.conn->Send(MakeHello(true));
+
+                auto& existing = m_mapNodes[nNodeID];
+                if(existing && existing != link.conn)
+                    existing->Disconnect();
+                existing = link.conn;
+
+                //Bring the new node up to date with who is here
+                std::vector<uint32_t> vLocal;
+                vLocal.reserve(m_mapLocal.size());
+                for(auto& client : m_mapLocal)
+                    vLocal.push_back(client.first);
+                Announce(relay_op::Joined, vLocal, link.conn);
+
+                Log(log_level::info, "Cluster Node Linked", nNodeID);
+            }
+
+            void OnRelayDirectory(relay_link& link, message<T>& msg, bool bJoined)
+            {
+                uint32_t nCount = 0;
+                if(!PopTrailer(msg, nCount) || msg.body.size() != size_t(nCount) * sizeof(uint32_t))
+                {
+                    Log(log_level::warning, "Malformed Relay Message", link.nNodeID);
+                    return;
+                }
+
+                for(uint32_t i = 0; i < nCount; i++)
+                {
+                    uint32_t nClientID;
+                    msg >> nClientID;
+
+                    if(bJoined)
+                    {
+                        m_mapDirectory[nClientID] = link.nNodeID;
+                    }
+                    else
+                    {
+                        auto owner = m_mapDirectory.find(nClientID);
+                        if(owner != m_mapDirectory.end() && owner->second == link.nNodeID)
+                            m_mapDirectory.erase(owner);
+                    }
+                }
+            }
+
+            //Rebuild the local directory and tell the other nodes what changed.
+            //Rate limited, a full pass over the connections is not free
+            void SyncLocalClients()
+            {
+                auto tNow = std::chrono::steady_clock::now();
+                if(tNow - m_tLastSync < tSyncInterval)
+                    return;
+                m_tLastSync = tNow;
+
+                std::unordered_map<uint32_t, std::shared_ptr<connection<T, Protocol>>> mapLocal;
+                mapLocal.reserve(this->m_deqConnections.size());
+
+                std::vector<uint32_t> vJoined;
+                for(auto& client : this->m_deqConnections)
+                {
+                    //ID 0 - accepted, not numbered yet
+                    if(!client || !client->IsConnected() || client->GetID() == 0)
+                        continue;
+
+                    uint32_t nClientID = client->GetID();
+                    mapLocal[nClientID] = client;
+                    if(m_mapLocal.find(nClientID) == m_mapLocal.end())
+                        vJoined.push_back(nClientID);
+                }
+
+                std::vector<uint32_t> vLeft;
+                for(auto& client : m_mapLocal)
+                {
+                    if(mapLocal.find(client.first) == mapLocal.end())
+                        vLeft.push_back(client.first);
+                }
+
+                m_mapLocal.swap(mapLocal);
+
+                Announce(relay_op::Joined, vJoined);
+                Announce(relay_op::Left, vLeft);
+            }
+
+            //To one link, or to every linked node
+            void Announce(relay_op op, const std::vector<uint32_t>& vClientIDs,
+                          const std::shared_ptr<relay_connection>& target = nullptr)
+            {
+                if(vClientIDs.empty() || (!target && m_mapNodes.empty()))
+                    return;
+
+                message<T> msg;
+                msg.reserve(vClientIDs.size() * sizeof(uint32_t) + 2 * sizeof(uint32_t));
+                for(uint32_t nClientID : vClientIDs)
+                    msg << nClientID;
+                msg << uint32_t(vClientIDs.size()) << uint32_t(op);
+
+                if(target)
+                {
+                    target->Send(std::move(msg));
+                    return;
+                }
+
+                for(auto& node : m_mapNodes)
+                {
+                    if(node.second->IsConnected())
+                        node.second->Send(msg);
+                }
+            }
+
+            void ForgetNode(uint32_t nNodeID)
+            {
+                for(auto it = m_mapDirectory.begin(); it != m_mapDirectory.end();)
+                {
+                    if(it->second == nNodeID)
+                        it = m_mapDirectory.erase(it);
+                    else
+                        ++it;
+                }
+            }
+
+            //Clients that connected since the last sync are only in m_deqConnections
+            std::shared_ptr<connection<T, Protocol>> FindLocalClient(uint32_t nClientID)
+            {
+                auto local = m_mapLocal.find(nClientID);
+                if(local != m_mapLocal.end())
+                    return local->second;
+
+                if((nClientID >> 24) != m_nNodeID)
+                    return nullptr;
+
+                for(auto& client : this->m_deqConnections)
+                {
+                    if(client && client->GetID() == nClientID)
+                        return client;
+                }
+                return nullptr;
+            }
+
+            static bool ValidNodeID(uint32_t nNodeID)
+            {
+                return nNodeID >= 1 && nNodeID <= 255;
+            }
+
+            static uint32_t CheckedNodeID(uint32_t nNodeID)
+            {
+                if(!ValidNodeID(nNodeID))
+                    throw std::invalid_argument("cluster node ID must be 1..255");
+                return nNodeID;
+            }
+
+            message<T> MakeHello(bool bWithSecret) const
+            {
+                message<T> msg;
+                uint32_t nSecretLength = bWithSecret ? uint32_t(m_sSecret.size()) : 0;
+                msg.body.assign(reinterpret_cast<const int8_t*>(m_sSecret.data()), nSecretLength);
+                msg << nSecretLength << m_nNodeID << uint32_t(relay_op::Hello);
+                return msg;
+            }
+
+            //Hello body with the trailers popped, compared in constant time
+            bool SecretMatches(const message<T>& msg) const
+            {
+                if(msg.body.size() != m_sSecret.size())
+                    return false;
+
+                uint8_t nDiff = 0;
+                for(size_t i = 0; i < m_sSecret.size(); i++)
+                    nDiff |= uint8_t(msg.body[i]) ^ uint8_t(m_sSecret[i]);
+                return nDiff == 0;
+            }
+
+            //operator>> does not check, relay links come from the network
+            static bool PopTrailer(message<T>& msg, uint32_t& n)
+            {
+                if(msg.body.size() < sizeof(uint32_t))
+                    return false;
+
+                msg >> n;
+                return true;
+            }
+
+        private:
+            static constexpr std::chrono::milliseconds tRedialInterval{1000};
+            static constexpr std::chrono::milliseconds tSyncInterval{100};
+            static constexpr std::chrono::milliseconds tDeadLinkGrace{5000};
+
+            uint32_t m_nNodeID;
+            std::string m_sSecret;
+
+            asio::ip::tcp::acceptor m_relayAcceptor;
+            asio::ip::tcp::endpoint m_relayEndpoint;
+
+            //Messages from every relay link
+            tsqueue<owned_message<T, asio::ip::tcp>> m_qRelayIn;
+
+            //Handed over from the asio thread by the relay acceptor
+            tsqueue<std::shared_ptr<relay_connection>> m_qAcceptedLinks;
+
+            //Answers to the peer lookups started by DialPeers()
+            tsqueue<resolved_peer> m_qResolvedPeers;
+
+            std::vector<relay_peer> m_vPeers;
+            std::vector<relay_link> m_vLinks;
+            std::deque<std::pair<std::chrono::steady_clock::time_point, std::shared_ptr<relay_connection>>> m_deqDeadLinks;
+
+            //Node ID -> its relay link, once it said Hello
+            std::unordered_map<uint32_t, std::shared_ptr<relay_connection>> m_mapNodes;
+
+            //Client ID -> node that owns it, for clients of other nodes
+            std::unordered_map<uint32_t, uint32_t> m_mapDirectory;
+
+            //Client ID -> connection, for clients of this node as of the last sync
+            std::unordered_map<uint32_t, std::shared_ptr<connection<T, Protocol>>> m_mapLocal;
+            std::chrono::steady_clock::time_point m_tLastSync;
+        };
+    }
+}
+
+#endif // NET_CLUSTER_H_INCLUDED
@@ -10,12 +10,65 @@
 #include <experimental/optional>
 #include <vector>
 #include <iostream>
+#include <sstream>
 #include <algorithm>
 #include <chrono>
 #include <cstdint>
+#include <limits>
+#include <cstring>
+#include <atomic>
+#include <future>
+
+#if defined(__linux__) && __has_include(<linux/io_uring.h>)
+    #include <unistd.h>
+    #include <sys/syscall.h>
+    #include <linux/io_uring.h>
+#endif
 
 #include <asio.hpp>
 #include <asio/ts/buffer.hpp>
 #include <asio/ts/internet.hpp>
 
+namespace olc
+{
+    namespace net
+    {
+        //Check whether the running kernel lets us create an io_uring instance.
+        //Kernels older than 5.1, or ones with io_uring disabled by sysctl/seccomp,
+        //say no. Only a probe - asio picks its backend at build time, see
+        //IoBackendName()
+        inline bool IoUringAvailable()
+        {
+        #if defined(__linux__) && __has_include(<linux/io_uring.h>)
+            io_uring_params params{};
+            int fd = static_cast<int>(syscall(__NR_io_uring_setup, 1, &params));
+            if(fd < 0)
+                return false;
+            close(fd);
+            return true;
+        #else
+            return false;
+        #endif
+        }
+
+        //Name of the I/O backend asio actually picked for this build
+        inline const char* IoBackendName()
+        {
+        #if defined(ASIO_HAS_IO_URING_AS_DEFAULT)
+            return "io_uring";
+        #elif defined(ASIO_HAS_IOCP)
+            return "iocp";
+        #elif defined(ASIO_HAS_EPOLL)
+            return "epoll";
+        #elif defined(ASIO_HAS_KQUEUE)
+            return "kqueue";
+        #elif defined(ASIO_HAS_DEV_POLL)
+            return "/dev/poll";
+        #else
+            return "select";
+        #endif
+        }
+    }
+}
+
 #endif // NET_COMMON_H_INCLUDED
@@ -4,23 +4,35 @@
 #include "net_common.h"
 #include "net_tsqueue.h"
 #include "net_message.h"
+#include "net_options.h"
+#include "net_ratelimit.h"
+#include "net_batch.h"
+#include "net_log.h"
+#include "net_clock.h"
+#include "net_schema.h"
 
 namespace olc
 {
     namespace net
     {
-        template<typename T>
-        class connection : public std::enable_shared_from_this<connection<T>>
+        //Always owned by a shared_ptr. Every posted lambda and async handler holds
+        //one as well, a connection lives until its last handler has run
+        template<typename T, typename Protocol>
+        class connection : public std::enable_shared_from_this<connection<T, Protocol>>
         {
         public:
+            typedef typename Protocol::socket socket_type;
+            typedef typename Protocol::endpoint endpoint_type;
+
             enum class owner
             {
                 server,
                 client
             };
-            connection(owner parent, asio::io_context& asioContext, asio::ip::tcp::socket socket,
-                       tsqueue<owned_message<T>>& qIn)
-                       : m_asioContext(asioContext), m_socket(std::move(socket)), m_qMessagesIn(qIn)
+            connection(owner parent, asio::io_context& asioContext, socket_type socket,
+                       tsqueue<owned_message<T, Protocol>>& qIn, const socket_options& opts = socket_options())
+                       : m_socket(std::move(socket)), m_asioContext(asioContext), m_qMessagesIn(qIn), m_options(opts),
+                         m_tmrThrottle(asioContext), m_tmrHeartbeat(asioContext)
             {
                 m_nOwnerType = parent;
             }
@@ -43,33 +55,46 @@ namespace olc
                     {
                         id = uid;
                         ReadHeader();
+                        StartHeartbeat();
                     }
                 }
             }
-            bool ConnectToServer(const asio::ip::tcp::resolver::results_type& endpoints)
+            //Any sequence of endpoints, e.g. the results of a tcp resolver
+            template<typename EndpointSequence>
+            bool ConnectToServer(const EndpointSequence& endpoints)
             {
                 if(m_nOwnerType == owner::client)
                 {
                     asio::async_connect(m_socket, endpoints,
-                        [this](std::error_code ec, asio::ip::tcp::endpoint endpoint)
+                        [this, self = this->shared_from_this()](std::error_code ec, endpoint_type endpoint)
                         {
                            if(!ec)
                            {
+                               //Socket only exists once connected, tune it before the first read
+                               ApplySocketOptions(m_socket, m_options);
                                ReadHeader();
+                               StartHeartbeat();
                            }
                            else
                            {
-                               std::cout << "Connect To Server Error: " << ec.message() << "\n";
-
+                               Log(log_level::error, "Connect To Server Failed", id, ec);
+                               //async_connect leaves the last attempt's socket open,
+                               //closed it reads as not connected and can be redialled
+                               m_socket.close();
                            }
                         });
+                    return true;
                 }
+                return false;
             }
 
             bool Disconnect()
             {
-                if(IsConnected())
-                    asio::post(m_asioContext, [this]() { m_socket.close(); });
+                if(!IsConnected())
+                    return false;
+
+                asio::post(m_asioContext, [this, self = this->shared_from_this()]() { m_socket.close(); });
+                return true;
             }
 
             bool IsConnected() const
@@ -77,43 +102,178 @@ namespace olc
                 return m_socket.is_open();
             }
 
+            //Budget for incoming traffic, set before the connection starts reading
+            void SetRateLimit(const rate_limit& limits)
+            {
+                m_limiter.Configure(limits);
+            }
+
+            //message_schema<T> checks incoming frames unless turned off here, for
+            //links whose messages carry more than the schema knows about, like
+            //cluster relays. Set before the connection starts reading
+            void SetSchemaChecked(bool bChecked)
+            {
+                m_bSchemaChecked = bChecked;
+            }
+
+            //Off for the client_interface's own connection, its messages carry
+            //nullptr and never keep the connection alive past the client
+            void SetRemoteTagged(bool bTagged)
+            {
+                m_bRemoteTagged = bTagged;
+            }
+
+            //Number of times reads were paused because the remote went over budget
+            uint64_t ThrottledCount() const
+            {
+                return m_limiter.ThrottledCount();
+            }
+
+            //Round trip, jitter and peer clock offset measured by heartbeats.
+            //Safe to call from any thread
+            link_timing Timing() const
+            {
+                return m_clock.Timing();
+            }
+
         public:
+            //The one copy the caller's message needs, it is moved from here on
             bool Send(const message<T>& msg)
             {
+                if(!CheckFrameSize(msg))
+                    return false;
+                return Send(message<T>(msg));
+            }
+
+            //No copy at all - the body travels to the write queue by move
+            bool Send(message<T>&& msg)
+            {
+                if(!CheckFrameSize(msg))
+                    return false;
+
+                m_nOutgoing++;
+                asio::post(m_asioContext,
+                    [this, self = this->shared_from_this(), msg = std::move(msg)]() mutable
+                    {
+                        PushOutgoing(std::move(msg));
+                    });
+                return true;
+            }
+
+            //Hold the message back until FlushSends(). Not thread safe, only the
+            //thread running the server tick may queue and flush.
+            //Returns true if this is the first message held since the last flush
+            bool QueueSend(const message<T>& msg)
+            {
+                if(!CheckFrameSize(msg))
+                    return false;
+                return QueueSend(message<T>(msg));
+            }
+
+            bool QueueSend(message<T>&& msg)
+            {
+                if(!CheckFrameSize(msg))
+                    return false;
+
+                m_vPendingOut.push_back(std::move(msg));
+                return m_vPendingOut.size() == 1;
+            }
+
+            //Hand every held message to the context with a single post
+            void FlushSends()
+            {
+                if(m_vPendingOut.empty())
+                    return;
+
+                m_nOutgoing += m_vPendingOut.size();
                 asio::post(m_asioContext,
-                    [this, msg]()
+                    [this, self = this->shared_from_this(), vBatch = std::move(m_vPendingOut)]() mutable
                     {
-                        bool bWritingMessage = !m_qMessagesOut.empty();
-                        m_qMessagesOut.push_back(msg);
+                        bool bWritingMessage = !m_qMessagesOut.empty() || !m_vWriteBatch.empty();
+                        m_qMessagesOut.push_back_range(vBatch.begin(), vBatch.end());
                         if(!bWritingMessage)
                         {
-                            WriteHeader();
+                            WriteNext();
                         }
                     });
+
+                m_vPendingOut.clear();
+            }
+
+            //Messages handed to Send()/FlushSends() that are not fully written yet.
+            //Safe to call from any thread
+            size_t OutgoingCount() const
+            {
+                return m_nOutgoing;
+            }
+
+            //Half-close - tell the remote we are done sending but keep reading,
+            //so everything already written still reaches it
+            void Shutdown()
+            {
+                asio::post(m_asioContext,
+                    [this, self = this->shared_from_this()]()
+                    {
+                        //Nothing may follow the half-close
+                        m_tmrHeartbeat.cancel();
+
+                        asio::error_code ec;
+                        m_socket.shutdown(asio::socket_base::shutdown_send, ec);
+                    });
             }
 
         private:
+            //Too big for one frame, refused instead of corrupting the stream
+            bool CheckFrameSize(const message<T>& msg) const
+            {
+                if(frame::FitsFrame(msg))
+                    return true;
+
+                Log(log_level::error, "Message Too Large", id, std::error_code(),
+                    std::to_string(msg.body.size()).c_str());
+                return false;
+            }
+
             //Async - Prime context ready to read message header
             void ReadHeader()
             {
-                asio::async_read(m_socket, asio::buffer(&m_msgTemporaryIn.header, sizeof(message_header<T>),
-                    [this](std::error_code ec, std::size_t length)
+                asio::async_read(m_socket, asio::buffer(&m_msgTemporaryIn.header, sizeof(message_header<T>)),
+                    [this, self = this->shared_from_this()](std::error_code ec, std::size_t length)
                     {
                        if(!ec)
                        {
-                            if(m_msgTemporaryIn.header.size > 0)
+                            //One syscall per write/read turnaround, not per header
+                            if(m_bQuickAckStale)
+                            {
+                                RefreshQuickAck(m_socket, m_options);
+                                m_bQuickAckStale = false;
+                            }
+
+                            //Rejected before anything is allocated for the body
+                            if(m_bSchemaChecked && !SchemaAllows(m_msgTemporaryIn.header))
+                            {
+                                Log(log_level::error, "Message Size Rejected", id, std::error_code(),
+                                    std::to_string(frame::BodySize(m_msgTemporaryIn.header)).c_str());
+                                m_socket.close();
+                                return;
+                            }
+
+                            if(frame::BodySize(m_msgTemporaryIn.header) > 0)
                             {
-                                m_msgTemporaryIn.body.resize(m_msgTemporaryIn.header.size);
+                                m_msgTemporaryIn.body.resize(frame::BodySize(m_msgTemporaryIn.header));
                                 ReadBody();
                             }
                             else
                             {
+                                //Control and batch frames are consumed in place, their
+                                //body would otherwise ride along with this message
+                                m_msgTemporaryIn.body.clear();
                                 AddToIncomingMessageQueue();
                             }
                        }
                        else
                        {
-                           std::cout << "[" << id << "] Read Header Failed\n";
+                           Log(log_level::warning, "Read Header Failed", id, ec);
                            //Checked by the server and removed in server.h
                            m_socket.close();
                        }
@@ -124,8 +284,8 @@ namespace olc
              //Async - Prime context ready to read message body
             void ReadBody()
             {
-                asio::async_read(m_socket, asio::buffer(&m_msgTemporaryIn.body.data(), m_msgTemporaryIn.body.size()),
-                    [this](std::error_code ec, std::size_t length)
+                asio::async_read(m_socket, asio::buffer(m_msgTemporaryIn.body.data(), m_msgTemporaryIn.body.size()),
+                    [this, self = this->shared_from_this()](std::error_code ec, std::size_t length)
                     {
                        if(!ec)
                        {
@@ -133,18 +293,174 @@ namespace olc
                        }
                        else
                        {
-                           std::cout << "[" << id << "] Read Body Failed\n";
+                           Log(log_level::warning, "Read Body Failed", id, ec);
                            //Checked by the server and removed in server.h
                            m_socket.close();
                        }
                     });
             }
 
+            //Context thread - queue msg and start writing, unless a write is in flight
+            void PushOutgoing(message<T>&& msg)
+            {
+                //A coalesced batch in flight has already been taken off the queue
+                bool bWritingMessage = !m_qMessagesOut.empty() || !m_vWriteBatch.empty();
+                m_qMessagesOut.push_back(std::move(msg));
+                if(!bWritingMessage)
+                {
+                    WriteNext();
+                }
+            }
+
+            //Context thread - first heartbeat now, then one per interval
+            void StartHeartbeat()
+            {
+                if(m_options.nHeartbeatMilliseconds == 0)
+                    return;
+
+                SendHeartbeat();
+                ScheduleHeartbeat();
+            }
+
+            void ScheduleHeartbeat()
+            {
+                m_tmrHeartbeat.expires_after(std::chrono::milliseconds(m_options.nHeartbeatMilliseconds));
+                m_tmrHeartbeat.async_wait(
+                    [this, self = this->shared_from_this()](std::error_code ec)
+                    {
+                        if(ec || !IsConnected())
+                            return;
+
+                        SendHeartbeat();
+                        ScheduleHeartbeat();
+                    });
+            }
+
+            void SendHeartbeat()
+            {
+                m_nOutgoing++;
+                PushOutgoing(frame::MakeControl<T>(frame::control_type::Heartbeat, m_clock.MakeHeartbeat(WallClockMicros())));
+            }
+
+            void HandleControlFrame()
+            {
+                //Unknown types are skipped, a newer peer may send more kinds
+                if(frame::ControlType(m_msgTemporaryIn.header) != frame::control_type::Heartbeat
+                   || m_msgTemporaryIn.body.size() != sizeof(heartbeat))
+                    return;
+
+                heartbeat hb;
+                std::memcpy(&hb, m_msgTemporaryIn.body.data(), sizeof(heartbeat));
+
+                uint64_t nSamples = m_clock.Timing().nSamples;
+                m_clock.OnHeartbeat(hb, WallClockMicros());
+
+                //Only one side has to send heartbeats, the other answers them - at
+                //most one per interval, so a flood of heartbeats is not echoed back
+                if(m_options.nHeartbeatMilliseconds == 0)
+                {
+                    auto tNow = std::chrono::steady_clock::now();
+                    if(tNow - m_tLastHeartbeatReply >= tHeartbeatReplyInterval)
+                    {
+                        m_tLastHeartbeatReply = tNow;
+                        SendHeartbeat();
+                    }
+                }
+
+                link_timing timing = m_clock.Timing();
+                if(timing.nSamples != nSamples && ShouldLog(log_level::debug))
+                {
+                    std::string sDetail = "rtt " + std::to_string(timing.rtt.count())
+                                        + "us jitter " + std::to_string(timing.rttVariance.count())
+                                        + "us offset " + std::to_string(timing.clockOffset.count()) + "us";
+                    Log(log_level::debug, "Link Timing", id, std::error_code(), sDetail.c_str());
+                }
+            }
+
+            //Start writing whatever is queued, in one go if coalescing is enabled
+            void WriteNext()
+            {
+                if(m_options.bCoalesceWrites || m_options.bBatchFrames)
+                    WriteCoalesced();
+                else
+                    WriteHeader();
+            }
+
+            //Async - Take as many queued messages as fit and write their headers
+            //and bodies with a single gather write (one syscall instead of 2 per message)
+            void WriteCoalesced()
+            {
+                size_t nBytes = 0;
+                m_nWriteBatchCount = 0;
+                while(!m_qMessagesOut.empty() && (m_vWriteBatch.empty() || nBytes < m_options.nMaxCoalescedBytes))
+                {
+                    message<T> msg = m_qMessagesOut.pop_front();
+                    m_nWriteBatchCount++;
+
+                    //A run of at least two small messages shares one batch frame
+                    if(IsBatchable(msg) && !m_qMessagesOut.empty() && IsBatchable(m_qMessagesOut.front()))
+                    {
+                        message<T> batch;
+                        batch.reserve(m_options.nMaxBatchedBodySize * 4);
+                        frame::Append(batch, msg);
+
+                        //Room is checked before appending, the frame never grows
+                        //past what a receiver's schema accepts, whatever
+                        //nMaxCoalescedBytes is set to
+                        while(!m_qMessagesOut.empty() && IsBatchable(m_qMessagesOut.front())
+                              && nBytes + batch.size() + frame::PackedSize(m_qMessagesOut.front()) <= m_options.nMaxCoalescedBytes
+                              && batch.body.size() + frame::PackedSize(m_qMessagesOut.front()) <= frame::nMaxBatchBodySize)
+                        {
+                            frame::Append(batch, m_qMessagesOut.pop_front());
+                            m_nWriteBatchCount++;
+                        }
+                        m_vWriteBatch.push_back(std::move(batch));
+                    }
+                    else
+                    {
+                        m_vWriteBatch.push_back(std::move(msg));
+                    }
+                    nBytes += m_vWriteBatch.back().size();
+                }
+
+                m_vWriteBuffers.clear();
+                for(const auto& msg : m_vWriteBatch)
+                {
+                    m_vWriteBuffers.push_back(asio::buffer(&msg.header, sizeof(message_header<T>)));
+                    if(!msg.body.empty())
+                        m_vWriteBuffers.push_back(asio::buffer(msg.body.data(), msg.body.size()));
+                }
+
+                m_bQuickAckStale = true;
+                asio::async_write(m_socket, m_vWriteBuffers,
+                    [this, self = this->shared_from_this()](std::error_code ec, std::size_t length)
+                    {
+                        if(!ec)
+                        {
+                            m_nOutgoing -= m_nWriteBatchCount;
+                            m_vWriteBatch.clear();
+
+                            //Anything sent while this batch was in flight goes out as the next batch
+                            if(!m_qMessagesOut.empty())
+                            {
+                                WriteCoalesced();
+                            }
+                        }
+                        else
+                        {
+                            Log(log_level::warning, "Write Coalesced Failed", id, ec);
+                            m_vWriteBatch.clear();
+                            m_socket.close();
+                        }
+                    });
+            }
+
              //Async - Prime context ready to write message header
             void WriteHeader()
             {
-                asio::write(m_socket, asio::buffer(&m_qMessagesOut.front(), sizeof(message_header<T>)),
-                    [this](std::error_code ec, std::size_t length)
+                m_bQuickAckStale = true;
+                asio::async_write(m_socket, asio::buffer(&m_qMessagesOut.front().header, sizeof(message_header<T>)),
+                    [this, self = this->shared_from_this()](std::error_code ec, std::size_t length)
                     {
                        if(!ec)
                        {
@@ -155,6 +471,7 @@ namespace olc
                             else
                             {
                                 m_qMessagesOut.pop_front();
+                                m_nOutgoing--;
 
                                 if(!m_qMessagesOut.empty())
                                 {
@@ -164,7 +481,7 @@ namespace olc
                        }
                        else
                        {
-                           std::cout << "[" << id << "] Write Header Failed\n";
+                           Log(log_level::warning, "Write Header Failed", id, ec);
                            m_socket.close();
                        }
                     });
@@ -173,14 +490,15 @@ namespace olc
              //Async - Prime context ready to write message body
             void WriteBody()
             {
-                asio::write(m_socket, asio::buffer(&m_qMessagesOut.front().body.data(), m_qMessagesOut.front().body.size()),
-                    [this](std::error_code ec, std::size_t length)
+                asio::async_write(m_socket, asio::buffer(m_qMessagesOut.front().body.data(), m_qMessagesOut.front().body.size()),
+                    [this, self = this->shared_from_this()](std::error_code ec, std::size_t length)
                     {
                         if (!ec)
 						{
 							// Sending was successful, so we are done with the message
 							// and remove it from the queue
 							m_qMessagesOut.pop_front();
+							m_nOutgoing--;
 
 							// If the queue still has messages in it, then issue the task to
 							// send the next messages' header.
@@ -192,19 +510,106 @@ namespace olc
 						else
 						{
 							// Sending failed, see WriteHeader() equivalent for description :P
-							std::cout << "[" << id << "] Write Body Fail.\n";
+							Log(log_level::warning, "Write Body Failed", id, ec);
 							m_socket.close();
 						}
 
-                    }
+                    });
+            }
+
+            bool IsBatchable(const message<T>& msg) const
+            {
+                return m_options.bBatchFrames && !frame::IsBatch(msg.header) && !frame::IsControl(msg.header)
+                    && msg.body.size() <= m_options.nMaxBatchedBodySize
+                    && frame::PackedSize(msg) <= frame::nMaxBatchBodySize;
+            }
+
+            //Messages are tagged with the connection they came from - server side,
+            //and links dialed by a cluster node. See SetRemoteTagged()
+            std::shared_ptr<connection<T, Protocol>> Remote()
+            {
+                return m_bRemoteTagged ? this->shared_from_this() : nullptr;
             }
 
             void AddToIncomingMessageQueue()
             {
-                if(m_OwnerType == owner::server)
-                    m_qMessagesIn.push_back({this->shared_from_this(), m_msgTemporaryIn});
+                bool bControl = frame::IsControl(m_msgTemporaryIn.header);
+
+                //A batch frame is unpacked once, a throttled retry reuses the result
+                bool bBatch = !bControl && frame::IsBatch(m_msgTemporaryIn.header);
+                if(bBatch && m_nUnpackedNext == m_vUnpacked.size())
+                {
+                    m_vUnpacked.clear();
+                    m_nUnpackedNext = 0;
+
+                    auto remote = Remote();
+                    bool bWithinSchema = true;
+                    bool bValid = frame::Unpack(m_msgTemporaryIn,
+                        [&](message<T>&& msg)
+                        {
+                            bWithinSchema = bWithinSchema && (!m_bSchemaChecked || SchemaAllows(msg.header));
+                            m_vUnpacked.push_back({remote, std::move(msg)});
+                        }) && bWithinSchema;
+
+                    if(!bValid || m_vUnpacked.empty())
+                    {
+                        Log(log_level::error, "Malformed Batch Frame", id);
+                        m_vUnpacked.clear();
+                        m_socket.close();
+                        return;
+                    }
+                }
+
+                //Over budget - hold the message and do not read any further. The
+                //socket buffer fills up and TCP pushes back on the sender, instead
+                //of the excess piling up in our queue
+                size_t nMessages = 1;
+                size_t nBytes = m_msgTemporaryIn.size();
+                if(bBatch)
+                {
+                    //A batch is admitted a burst at a time, packing messages
+                    //together does not buy a client a bigger budget
+                    nMessages = std::min(m_vUnpacked.size() - m_nUnpackedNext, m_limiter.MaxMessagesPerAcquire());
+                    nBytes = 0;
+                    for(size_t i = m_nUnpackedNext; i < m_nUnpackedNext + nMessages; i++)
+                        nBytes += m_vUnpacked[i].msg.size();
+                }
+
+                if(m_limiter.Enabled())
+                {
+                    auto tWait = m_limiter.TryAcquire(nBytes, nMessages);
+                    if(tWait != std::chrono::steady_clock::duration::zero())
+                    {
+                        m_tmrThrottle.expires_after(tWait);
+                        m_tmrThrottle.async_wait(
+                            [this, self = this->shared_from_this()](std::error_code ec)
+                            {
+                                if(!ec)
+                                    AddToIncomingMessageQueue();
+                            });
+                        return;
+                    }
+                }
+
+                //Control frames are charged like any message, then handled here
+                //and never reach the message queue
+                if(bControl)
+                    HandleControlFrame();
+                else if(bBatch)
+                {
+                    auto first = m_vUnpacked.begin() + m_nUnpackedNext;
+                    m_qMessagesIn.push_back_range(first, first + nMessages);
+                    m_nUnpackedNext += nMessages;
+
+                    //Rest of the batch waits for the next acquire
+                    if(m_nUnpackedNext < m_vUnpacked.size())
+                    {
+                        AddToIncomingMessageQueue();
+                        return;
+                    }
+                }
                 else
-                    m_qMessagesIn.push_back({nullptr, m_msgTemporaryIn});
+                    m_qMessagesIn.push_back({Remote(), std::move(m_msgTemporaryIn)});
 
 
                 //Register another task for the context to handle
@@ -213,7 +618,7 @@ namespace olc
 
         protected:
             //Each connection has a unique socket to a remote
-            asio::ip::tcp::socket m_socket;
+            socket_type m_socket;
 
             //This context is shared among all asio connections
             asio::io_context& m_asioContext;
@@ -225,7 +630,48 @@ namespace olc
             //This queue holds all messages to be received from the remote
             //site of this connection. It is only a reference as the owner
             //would provide the queue
-            tsqueue<owned_message<T>>& m_qMessagesIn;
+            tsqueue<owned_message<T, Protocol>>& m_qMessagesIn;
+
+            //Messages taken off m_qMessagesOut for the coalesced write in flight,
+            //they must stay alive until the write completes
+            std::vector<message<T>> m_vWriteBatch;
+            std::vector<asio::const_buffer> m_vWriteBuffers;
+            //Messages in m_vWriteBatch, batch frames hold more than one
+            size_t m_nWriteBatchCount = 0;
+
+            //Messages unpacked from the last batch frame read, waiting to be queued
+            std::vector<owned_message<T, Protocol>> m_vUnpacked;
+            size_t m_nUnpackedNext = 0;
+
+            //Messages held back by QueueSend() during a server tick
+            std::vector<message<T>> m_vPendingOut;
+
+            //Messages accepted for sending but not yet written, read by Drain()
+            std::atomic<size_t> m_nOutgoing{0};
+
+            //Socket tuning, applied once the socket is connected
+            socket_options m_options;
+
+            //Data went out since TCP_QUICKACK was last set, the kernel may have cleared it
+            bool m_bQuickAckStale = false;
+
+            //See SetSchemaChecked()
+            bool m_bSchemaChecked = true;
+
+            //See SetRemoteTagged()
+            bool m_bRemoteTagged = true;
+
+            //Incoming traffic budget and the timer that resumes reading
+            connection_limiter m_limiter;
+            asio::steady_timer m_tmrThrottle;
+
+            //Heartbeats and what they measured
+            asio::steady_timer m_tmrHeartbeat;
+            clock_estimator m_clock;
+
+            //Answering side only - when the last reply went out, and how often it may
+            static constexpr std::chrono::milliseconds tHeartbeatReplyInterval{100};
+            std::chrono::steady_clock::time_point m_tLastHeartbeatReply;
 
             //The owner decides how some of the connection behaves
             owner m_nOwnerType = owner::server;
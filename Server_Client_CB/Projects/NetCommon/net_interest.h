@@ -0,0 +1,200 @@
+#pragma once
+
+#ifndef NET_INTEREST_H_INCLUDED
+#define NET_INTEREST_H_INCLUDED
+
+#include "net_common.h"
+#include "net_message.h"
+
+#include <unordered_map>
+#include <cmath>
+
+namespace olc
+{
+    namespace net
+    {
+        /*
+        Example
+        olc::net::interest_grid<CustomMsgTypes> interest(64.0f);
+
+        //Whenever a player moves
+        interest.SetPosition(client, x, y, 200.0f);
+
+        //Only clients that can see the explosion hear about it
+        MessageClientsInArea(msg, interest, ex, ey, 10.0f);
+
+        //In OnClientDisconnect
+        interest.Remove(client->GetID());
+        */
+
+        //Uniform grid over client positions. Each client sits in the cell of its
+        //position with an area-of-interest radius, a query only visits the cells
+        //that can contain a client whose area overlaps the event
+        template <typename T, typename Protocol = asio::ip::tcp>
+        class interest_grid
+        {
+        public:
+            //Cells around the typical area-of-interest radius keep queries to a few cells
+            interest_grid(float fCellSize = 64.0f)
+                : m_fCellSize(fCellSize > 0.0f ? fCellSize : 64.0f)
+            {}
+
+        public:
+            //Insert or move a client
+            void SetPosition(std::shared_ptr<connection<T, Protocol>> client, float x, float y, float fRadius)
+            {
+                if(!client)
+                    return;
+
+                uint32_t nID = client->GetID();
+                uint64_t nCell = CellKey(CellCoord(x), CellCoord(y));
+
+                auto it = m_mapClients.find(nID);
+                if(it == m_mapClients.end())
+                {
+                    m_mapClients[nID] = { std::move(client), x, y, fRadius, nCell };
+                    m_mapCells[nCell].push_back(nID);
+                }
+                else
+                {
+                    auto& e = it->second;
+                    if(e.nCell != nCell)
+                    {
+                        RemoveFromCell(e.nCell, nID);
+                        m_mapCells[nCell].push_back(nID);
+                        e.nCell = nCell;
+                    }
+                    e.x = x;
+                    e.y = y;
+                    e.fRadius = fRadius;
+                }
+
+                m_fMaxRadius = std::max(m_fMaxRadius, fRadius);
+            }
+
+            void Remove(uint32_t nID)
+            {
+                auto it = m_mapClients.find(nID);
+                if(it == m_mapClients.end())
+                    return;
+
+                RemoveFromCell(it->second.nCell, nID);
+                m_mapClients.erase(it);
+            }
+
+            //Call fn(client) for every client whose area of interest overlaps the
+            //circle at x,y. Cost scales with the clients nearby, not the world
+            template <typename Func>
+            void Query(float x, float y, float fRadius, Func&& fn) const
+            {
+                float fReach = fRadius + m_fMaxRadius;
+                int32_t x0 = CellCoord(x - fReach), x1 = CellCoord(x + fReach);
+                int32_t y0 = CellCoord(y - fReach), y1 = CellCoord(y + fReach);
+
+                auto visit = [&](const std::vector<uint32_t>& vIDs)
+                {
+                    for(uint32_t nID : vIDs)
+                    {
+                        const auto& e = m_mapClients.at(nID);
+                        float dx = e.x - x, dy = e.y - y;
+                        float r = e.fRadius + fRadius;
+                        if(dx * dx + dy * dy <= r * r)
+                            fn(e.client);
+                    }
+                };
+
+                //A huge radius somewhere makes the range bigger than the world,
+                //then walking the occupied cells is cheaper than the range
+                uint64_t nRange = uint64_t(int64_t(x1) - x0 + 1) * uint64_t(int64_t(y1) - y0 + 1);
+                if(nRange > m_mapCells.size())
+                {
+                    for(const auto& cell : m_mapCells)
+                    {
+                        int32_t cx = int32_t(uint32_t(cell.first >> 32));
+                        int32_t cy = int32_t(uint32_t(cell.first));
+                        if(cx >= x0 && cx <= x1 && cy >= y0 && cy <= y1)
+                            visit(cell.second);
+                    }
+                    return;
+                }
+
+                for(int32_t cy = y0; cy <= y1; cy++)
+                {
+                    for(int32_t cx = x0; cx <= x1; cx++)
+                    {
+                        auto cell = m_mapCells.find(CellKey(cx, cy));
+                        if(cell != m_mapCells.end())
+                            visit(cell->second);
+                    }
+                }
+            }
+
+            size_t Count() const
+            {
+                return m_mapClients.size();
+            }
+
+            void Clear()
+            {
+                m_mapClients.clear();
+                m_mapCells.clear();
+                m_fMaxRadius = 0.0f;
+            }
+
+        private:
+            struct entry
+            {
+                std::shared_ptr<connection<T, Protocol>> client;
+                float x;
+                float y;
+                float fRadius;
+                uint64_t nCell;
+            };
+
+            //Clamped well inside int32_t, so inf / NaN / huge positions stay
+            //defined and range loops cannot overflow
+            int32_t CellCoord(float v) const
+            {
+                const double fLimit = double(1 << 30);
+                double f = std::floor(double(v) / m_fCellSize);
+                if(std::isnan(f))
+                    return 0;
+                return int32_t(std::min(fLimit, std::max(-fLimit, f)));
+            }
+
+            static uint64_t CellKey(int32_t cx, int32_t cy)
+            {
+                return (uint64_t(uint32_t(cx)) << 32) | uint64_t(uint32_t(cy));
+            }
+
+            void RemoveFromCell(uint64_t nCell, uint32_t nID)
+            {
+                auto cell = m_mapCells.find(nCell);
+                if(cell == m_mapCells.end())
+                    return;
+
+                auto& v = cell->second;
+                auto it = std::find(v.begin(), v.end(), nID);
+                if(it != v.end())
+                {
+                    *it = v.back();
+                    v.pop_back();
+                }
+
+                if(v.empty())
+                    m_mapCells.erase(cell);
+            }
+
+        private:
+            float m_fCellSize;
+            //Largest radius ever set, bounds how far a query has to look.
+            //It only grows - past the occupied cell count a query walks those instead
+            float m_fMaxRadius = 0.0f;
+
+            std::unordered_map<uint32_t, entry> m_mapClients;
+            std::unordered_map<uint64_t, std::vector<uint32_t>> m_mapCells;
+        };
+    }
+}
+
+#endif // NET_INTEREST_H_INCLUDED
@@ -0,0 +1,367 @@
+#pragma once
+
+#ifndef NET_LOG_H_INCLUDED
+#define NET_LOG_H_INCLUDED
+
+#include "net_common.h"
+
+#include <array>
+#include <iomanip>
+#include <condition_variable>
+
+namespace olc
+{
+    namespace net
+    {
+        /*
+        Example
+        olc::net::async_logger::Get().SetLevel(olc::net::log_level::warning);
+
+        //From any thread - never blocks, the record is copied into a ring
+        //owned by the calling thread and written out by the flusher thread
+        olc::net::Log(olc::net::log_level::error, "Read Header Failed", nConnID, ec);
+        */
+
+        enum class log_level : uint8_t
+        {
+            trace,
+            debug,
+            info,
+            warning,
+            error,
+            none
+        };
+
+        inline const char* LogLevelName(log_level level)
+        {
+            switch(level)
+            {
+            case log_level::trace:   return "trace";
+            case log_level::debug:   return "debug";
+            case log_level::info:    return "info";
+            case log_level::warning: return "warn";
+            case log_level::error:   return "error";
+            default:                 return "none";
+            }
+        }
+
+        //One log line with its structured fields. Fixed size, nothing in here
+        //allocates. Errors are kept as category name + value, the category object
+        //itself may already be gone when the flusher gets to the record at exit
+        struct log_record
+        {
+            std::chrono::system_clock::time_point tWhen;
+            log_level level;
+            //Must be a string literal or otherwise outlive the flusher
+            const char* szEvent;
+            uint32_t nConnID;
+            int nError;
+            const char* szCategory;
+            char szDetail[80];
+        };
+
+        //Single producer / single consumer ring, one per logging thread
+        class log_ring
+        {
+        public:
+            static constexpr size_t nCapacity = 1024;
+
+            //Producer side - false when full, the record is dropped
+            bool Push(const log_record& record)
+            {
+                size_t nTail = m_nTail.load(std::memory_order_relaxed);
+                if(nTail - m_nHead.load(std::memory_order_acquire) == nCapacity)
+                {
+                    m_nDropped.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+
+                m_aRecords[nTail % nCapacity] = record;
+                m_nTail.store(nTail + 1, std::memory_order_release);
+                return true;
+            }
+
+            //Consumer side
+            template <typename Func>
+            size_t Drain(Func&& fn)
+            {
+                size_t nHead = m_nHead.load(std::memory_order_relaxed);
+                size_t nTail = m_nTail.load(std::memory_order_acquire);
+                size_t nCount = nTail - nHead;
+
+                for(; nHead != nTail; ++nHead)
+                    fn(m_aRecords[nHead % nCapacity]);
+
+                m_nHead.store(nHead, std::memory_order_release);
+                return nCount;
+            }
+
+            uint64_t Dropped() const
+            {
+                return m_nDropped.load(std::memory_order_relaxed);
+            }
+
+            //Producer side - the owning thread exited, nothing is pushed after this
+            void Retire()
+            {
+                m_bRetired.store(true, std::memory_order_release);
+            }
+
+            //Consumer side - check before the last Drain, records pushed before
+            //Retire() are visible to it
+            bool Retired() const
+            {
+                return m_bRetired.load(std::memory_order_acquire);
+            }
+
+        private:
+            std::array<log_record, nCapacity> m_aRecords;
+            std::atomic<size_t> m_nHead{0};
+            std::atomic<size_t> m_nTail{0};
+            std::atomic<uint64_t> m_nDropped{0};
+            std::atomic<bool> m_bRetired{false};
+        };
+
+        //Process wide logger. Threads write into their own ring without locks,
+        //a background thread formats and writes the records out. A full ring
+        //drops records rather than stall the I/O thread that produced them
+        class async_logger
+        {
+        public:
+            static async_logger& Get()
+            {
+                static async_logger logger;
+                return logger;
+            }
+
+            async_logger(const async_logger&) = delete;
+
+            ~async_logger()
+            {
+                {
+                    std::scoped_lock lock(m_muxFlusher);
+                    m_bRunning = false;
+                }
+                m_cvFlusher.notify_one();
+
+                if(m_threadFlusher.joinable())
+                    m_threadFlusher.join();
+
+                Flush();
+            }
+
+        public:
+            void SetLevel(log_level level)
+            {
+                m_level = level;
+            }
+
+            log_level Level() const
+            {
+                return m_level;
+            }
+
+            //Check before building anything expensive for a record
+            bool ShouldLog(log_level level) const
+            {
+                return level >= m_level.load(std::memory_order_relaxed) && level != log_level::none;
+            }
+
+            //Where records end up, std::cout unless told otherwise
+            void SetSink(std::ostream& os)
+            {
+                std::scoped_lock lock(m_muxSink);
+                m_pSink = &os;
+            }
+
+            //Shortest time between two flushes, a burst of records is written in
+            //one go. The flusher sleeps while nothing is logged
+            void SetFlushInterval(std::chrono::milliseconds tInterval)
+            {
+                m_tFlushInterval = tInterval;
+            }
+
+            void Write(log_level level, const char* szEvent, uint32_t nConnID = 0,
+                       const std::error_code& ec = std::error_code(), const char* szDetail = nullptr)
+            {
+                if(!ShouldLog(level))
+                    return;
+
+                log_record record;
+                record.tWhen = std::chrono::system_clock::now();
+                record.level = level;
+                record.szEvent = szEvent;
+                record.nConnID = nConnID;
+                record.nError = ec.value();
+                record.szCategory = ec ? ec.category().name() : nullptr;
+                record.szDetail[0] = '\0';
+                if(szDetail)
+                {
+                    std::strncpy(record.szDetail, szDetail, sizeof(record.szDetail) - 1);
+                    record.szDetail[sizeof(record.szDetail) - 1] = '\0';
+                }
+
+                LocalRing().Push(record);
+
+                //Only the first record since the last flush wakes the flusher. Both
+                //sides swap the flag, so the flusher's swap sees this push
+                if(!m_bPending.exchange(true))
+                {
+                    std::scoped_lock lock(m_muxFlusher);
+                    m_cvFlusher.notify_one();
+                }
+            }
+
+            //Write out everything logged so far, from the calling thread
+            void Flush()
+            {
+                std::vector<std::shared_ptr<log_ring>> vRings;
+                {
+                    std::scoped_lock lock(m_muxRings);
+                    vRings = m_vRings;
+                }
+
+                std::vector<std::shared_ptr<log_ring>> vRetired;
+                {
+                    std::scoped_lock lock(m_muxSink);
+                    for(auto& ring : vRings)
+                    {
+                        bool bRetired = ring->Retired();
+                        ring->Drain([this](const log_record& record) { Format(record); });
+                        if(bRetired)
+                            vRetired.push_back(ring);
+                    }
+                    m_pSink->flush();
+                }
+
+                //Rings of exited threads are empty now and can go
+                if(!vRetired.empty())
+                {
+                    std::scoped_lock lock(m_muxRings);
+                    for(auto& ring : vRetired)
+                    {
+                        m_nRetiredDropped += ring->Dropped();
+                        m_vRings.erase(std::remove(m_vRings.begin(), m_vRings.end(), ring), m_vRings.end());
+                    }
+                }
+            }
+
+            //Records lost to full rings since start
+            uint64_t Dropped()
+            {
+                std::scoped_lock lock(m_muxRings);
+                uint64_t nDropped = m_nRetiredDropped;
+                for(auto& ring : m_vRings)
+                    nDropped += ring->Dropped();
+                return nDropped;
+            }
+
+        private:
+            async_logger()
+            {
+                m_threadFlusher = std::thread([this]() { FlusherLoop(); });
+            }
+
+            //Retires the thread's ring when the thread exits. Only touches the
+            //ring, the logger may already be gone by then
+            struct ring_owner
+            {
+                std::shared_ptr<log_ring> ring;
+
+                ~ring_owner()
+                {
+                    if(ring)
+                        ring->Retire();
+                }
+            };
+
+            //Registration takes a lock once per thread, writes never do.
+            //Rings are shared so records of a finished thread still get flushed,
+            //the flusher frees the ring after that
+            log_ring& LocalRing()
+            {
+                thread_local ring_owner owner;
+                if(!owner.ring)
+                {
+                    owner.ring = std::make_shared<log_ring>();
+                    std::scoped_lock lock(m_muxRings);
+                    m_vRings.push_back(owner.ring);
+                }
+                return *owner.ring;
+            }
+
+            void FlusherLoop()
+            {
+                std::unique_lock<std::mutex> lock(m_muxFlusher);
+                while(true)
+                {
+                    m_cvFlusher.wait(lock, [this]() { return m_bPending || !m_bRunning; });
+                    if(!m_bRunning)
+                        return;
+
+                    //Cleared first, a record logged during the flush wakes us again
+                    m_bPending.exchange(false);
+                    lock.unlock();
+                    Flush();
+                    lock.lock();
+
+                    m_cvFlusher.wait_for(lock, m_tFlushInterval.load(), [this]() { return !m_bRunning; });
+                }
+            }
+
+            //Flusher thread only, holds m_muxSink
+            void Format(const log_record& record)
+            {
+                auto tTime = std::chrono::system_clock::to_time_t(record.tWhen);
+                auto nMillis = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    record.tWhen.time_since_epoch()).count() % 1000;
+
+                char szTime[32];
+                std::strftime(szTime, sizeof(szTime), "%H:%M:%S", std::localtime(&tTime));
+
+                std::ostream& os = *m_pSink;
+                os << szTime << "." << std::setfill('0') << std::setw(3) << nMillis << std::setfill(' ')
+                   << " [" << LogLevelName(record.level) << "]";
+                if(record.nConnID != 0)
+                    os << " [" << record.nConnID << "]";
+                os << " " << record.szEvent;
+                if(record.szDetail[0] != '\0')
+                    os << ": " << record.szDetail;
+                if(record.szCategory)
+                    os << " (ec=" << record.szCategory << ":" << record.nError << ")";
+                os << "\n";
+            }
+
+        private:
+            std::atomic<log_level> m_level{log_level::info};
+            std::atomic<std::chrono::milliseconds> m_tFlushInterval{std::chrono::milliseconds(10)};
+
+            std::mutex m_muxRings;
+            std::vector<std::shared_ptr<log_ring>> m_vRings;
+            uint64_t m_nRetiredDropped = 0;
+
+            std::mutex m_muxSink;
+            std::ostream* m_pSink = &std::cout;
+
+            std::mutex m_muxFlusher;
+            std::condition_variable m_cvFlusher;
+            bool m_bRunning = true;
+            //Something was logged since the flusher last looked
+            std::atomic<bool> m_bPending{false};
+            std::thread m_threadFlusher;
+        };
+
+        inline void Log(log_level level, const char* szEvent, uint32_t nConnID = 0,
+                        const std::error_code& ec = std::error_code(), const char* szDetail = nullptr)
+        {
+            async_logger::Get().Write(level, szEvent, nConnID, ec, szDetail);
+        }
+
+        inline bool ShouldLog(log_level level)
+        {
+            return async_logger::Get().ShouldLog(level);
+        }
+    }
+}
+
+#endif // NET_LOG_H_INCLUDED
@@ -36,6 +36,159 @@ namespace olc
         msg >> d >> c >> b >> a;
         */
 
+		//Bodies up to this many bytes live inside the message itself, anything
+		//larger goes to the heap. Override at build time with -DOLC_NET_INLINE_BODY_SIZE=n
+		#ifndef OLC_NET_INLINE_BODY_SIZE
+		#define OLC_NET_INLINE_BODY_SIZE 64
+		#endif
+
+		//Byte buffer for message bodies with small buffer optimisation. Most game
+		//messages are a few floats, so they never touch the allocator. Growth is
+		//geometric, pushing fields one by one does not reallocate every time.
+		//Unlike std::vector, resize() leaves new bytes uninitialised - every
+		//caller overwrites them straight away
+		class message_body
+		{
+		public:
+			static constexpr size_t nInlineSize = OLC_NET_INLINE_BODY_SIZE;
+
+			message_body() = default;
+
+			message_body(const message_body& other)
+			{
+				assign(other.data(), other.size());
+			}
+
+			message_body(message_body&& other) noexcept
+			{
+				steal(other);
+			}
+
+			message_body& operator=(const message_body& other)
+			{
+				if(this != &other)
+				{
+					m_nSize = 0;
+					assign(other.data(), other.size());
+				}
+				return *this;
+			}
+
+			message_body& operator=(message_body&& other) noexcept
+			{
+				if(this != &other)
+				{
+					m_pHeap.reset();
+					m_nCapacity = nInlineSize;
+					steal(other);
+				}
+				return *this;
+			}
+
+		public:
+			int8_t* data()
+			{
+				return m_pHeap ? m_pHeap.get() : m_aInline;
+			}
+
+			const int8_t* data() const
+			{
+				return m_pHeap ? m_pHeap.get() : m_aInline;
+			}
+
+			size_t size() const
+			{
+				return m_nSize;
+			}
+
+			size_t capacity() const
+			{
+				return m_nCapacity;
+			}
+
+			bool empty() const
+			{
+				return m_nSize == 0;
+			}
+
+			bool is_inline() const
+			{
+				return !m_pHeap;
+			}
+
+			int8_t& operator[](size_t i)
+			{
+				return data()[i];
+			}
+
+			const int8_t& operator[](size_t i) const
+			{
+				return data()[i];
+			}
+
+			int8_t* begin() { return data(); }
+			int8_t* end() { return data() + m_nSize; }
+			const int8_t* begin() const { return data(); }
+			const int8_t* end() const { return data() + m_nSize; }
+
+			//Make room for at least nCapacity bytes, contents are kept
+			void reserve(size_t nCapacity)
+			{
+				if(nCapacity <= m_nCapacity)
+					return;
+
+				std::unique_ptr<int8_t[]> pNew(new int8_t[nCapacity]);
+				if(m_nSize > 0)
+					std::memcpy(pNew.get(), data(), m_nSize);
+				m_pHeap = std::move(pNew);
+				m_nCapacity = nCapacity;
+			}
+
+			void resize(size_t nSize)
+			{
+				if(nSize > m_nCapacity)
+					reserve(std::max(nSize, m_nCapacity * 2));
+				m_nSize = nSize;
+			}
+
+			//Keeps the capacity, a reused message does not allocate again
+			void clear()
+			{
+				m_nSize = 0;
+			}
+
+			void assign(const int8_t* pData, size_t nSize)
+			{
+				resize(nSize);
+				if(nSize > 0)
+					std::memcpy(data(), pData, nSize);
+			}
+
+		private:
+			void steal(message_body& other)
+			{
+				if(other.m_pHeap)
+				{
+					m_pHeap = std::move(other.m_pHeap);
+					m_nCapacity = other.m_nCapacity;
+				}
+				else if(other.m_nSize > 0)
+				{
+					std::memcpy(m_aInline, other.m_aInline, other.m_nSize);
+				}
+				m_nSize = other.m_nSize;
+
+				other.m_nSize = 0;
+				other.m_nCapacity = nInlineSize;
+			}
+
+		private:
+			std::unique_ptr<int8_t[]> m_pHeap;
+			size_t m_nSize = 0;
+			size_t m_nCapacity = nInlineSize;
+			alignas(8) int8_t m_aInline[nInlineSize];
+		};
+
 		//Message Header is sent at start of all messages. The template allows us
 		// to use 'enum class' to ensure that all messages are valid at compile time
 		template <typename T>
@@ -49,13 +202,19 @@ namespace olc
 		struct message
 		{
 			message_header<T> header{};
-			std::vector<int8_t> body;
+			message_body body;
 
 			size_t size() const
 			{
 				return sizeof(message_header<T>) + body.size();
 			}
 
+			//Size hint for messages built from many fields, one allocation at most
+			void reserve(size_t nBodySize)
+			{
+				body.reserve(nBodySize);
+			}
+
 			//Override std::cout compatibility - produces friendly description of message
             friend std::ostream& operator << (std::ostream& os, const message<T>& msg)
             {
@@ -71,12 +230,12 @@ namespace olc
 
                 size_t i = msg.body.size();
 
-                //Resizing causes some overhead, as we are resizing every message
+                //Inline up to OLC_NET_INLINE_BODY_SIZE, then grows geometrically
                 msg.body.resize(msg.body.size() + sizeof(DataType));
 
                 std::memcpy(msg.body.data() + i , &data, sizeof(DataType));
 
-                msg.header.size = msg.size();
+                msg.header.size = msg.body.size();
 
                 return msg;
             }
@@ -92,28 +251,150 @@ namespace olc
 
                 msg.body.resize(i);
 
-                msg.header.size = msg.size();
+                msg.header.size = msg.body.size();
 
                 return msg;
             }
 		};
 
+		/*
+		Example
+		olc::net::message_view<CustomMsgTypes> view(msg);
+
+		//Fields come out in the order they were pushed, the message is untouched
+		view >> a >> b >> c >> d;
+		if(!view)
+			return; //Message was shorter than expected
+		*/
+
+		//Non-owning reader over a message body. Decodes front-to-back from a cursor
+		//without resizing or rewriting the message, each field costs only the memcpy
+		//into the caller's variable. The underlying buffer must outlive the view
+		template <typename T>
+		struct message_view
+		{
+			message_header<T> header{};
+
+			message_view() = default;
+
+			message_view(const message<T>& msg)
+				: header(msg.header), m_pData(msg.body.data()), m_nSize(msg.body.size())
+			{}
+
+			//View straight over a receive buffer
+			message_view(const message_header<T>& hdr, const int8_t* pData, size_t nSize)
+				: header(hdr), m_pData(pData), m_nSize(nSize)
+			{}
+
+			size_t size() const
+			{
+				return m_nSize;
+			}
+
+			size_t remaining() const
+			{
+				return m_nSize - m_nOffset;
+			}
+
+			//False once any read ran past the end of the body
+			bool good() const
+			{
+				return !m_bFailed;
+			}
+
+			explicit operator bool() const
+			{
+				return good();
+			}
+
+			//Copy the next POD-like field out of the body
+			template <typename DataType>
+			bool read(DataType& data)
+			{
+				static_assert(std::is_standard_layout<DataType>::value, "Data is too complex");
+
+				if(m_bFailed || remaining() < sizeof(DataType))
+				{
+					m_bFailed = true;
+					return false;
+				}
+
+				std::memcpy(&data, m_pData + m_nOffset, sizeof(DataType));
+				m_nOffset += sizeof(DataType);
+				return true;
+			}
+
+			//Copy nCount elements into an array
+			template <typename DataType>
+			bool read_array(DataType* pData, size_t nCount)
+			{
+				static_assert(std::is_standard_layout<DataType>::value, "Data is too complex");
+
+				if(m_bFailed || nCount > remaining() / sizeof(DataType))
+				{
+					m_bFailed = true;
+					return false;
+				}
+
+				std::memcpy(pData, m_pData + m_nOffset, nCount * sizeof(DataType));
+				m_nOffset += nCount * sizeof(DataType);
+				return true;
+			}
+
+			//Zero-copy - point at the next nBytes inside the body and step over them.
+			//Returns nullptr if the body is too short. The bytes are not aligned,
+			//copy them out before treating them as anything but bytes
+			const int8_t* read_bytes(size_t nBytes)
+			{
+				if(m_bFailed || remaining() < nBytes)
+				{
+					m_bFailed = true;
+					return nullptr;
+				}
+
+				const int8_t* p = m_pData + m_nOffset;
+				m_nOffset += nBytes;
+				return p;
+			}
+
+			//Step over fields that are not needed
+			bool skip(size_t nBytes)
+			{
+				return read_bytes(nBytes) != nullptr;
+			}
+
+            template <typename DataType>
+            friend message_view<T>& operator >> (message_view<T>& view, DataType& data)
+            {
+                view.read(data);
+                return view;
+            }
+
+		private:
+			const int8_t* m_pData = nullptr;
+			size_t m_nSize = 0;
+			size_t m_nOffset = 0;
+			bool m_bFailed = false;
+		};
+
         // An "owned" message is identical to a regular message, but it is associated with
 		// a connection. On a server, the owner would be the client that sent the message,
 		// on a client the owner would be the server.
 
-		// Forward declare the connection
-		template <typename T>
+		// Forward declare the connection. Protocol is the asio stream protocol the
+		// connection runs on - TCP by default, asio::local::stream_protocol for
+		// same-host clients over a Unix domain socket
+		template <typename T, typename Protocol = asio::ip::tcp>
 		class connection;
 
-		template <typename T>
+		template <typename T, typename Protocol = asio::ip::tcp>
 		struct owned_message
 		{
-			std::shared_ptr<connection<T>> remote = nullptr;
+			std::shared_ptr<connection<T, Protocol>> remote = nullptr;
 			message<T> msg;
 
 			// Again, a friendly string maker
-			friend std::ostream& operator<<(std::ostream& os, const owned_message<T>& msg)
+			friend std::ostream& operator<<(std::ostream& os, const owned_message<T, Protocol>& msg)
 			{
 				os << msg.msg;
 				return os;
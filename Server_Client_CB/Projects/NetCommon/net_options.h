@@ -0,0 +1,237 @@
+#pragma once
+
+#ifndef NET_OPTIONS_H_INCLUDED
+#define NET_OPTIONS_H_INCLUDED
+
+#include "net_common.h"
+#include "net_log.h"
+
+#include <stdexcept>
+
+#if defined(__linux__)
+    #include <netinet/tcp.h>
+    #include <sys/socket.h>
+#endif
+
+namespace olc
+{
+    namespace net
+    {
+        /*
+        Example
+        CustomServer server(60000);
+        server.SetSocketOptions(olc::net::socket_options::LatencyMode());
+        server.Start();
+        */
+
+        //Socket level tuning applied to every connection of a server or client.
+        //A value of 0 / false leaves the kernel default untouched
+        struct socket_options
+        {
+            //Disable Nagle, small messages leave immediately instead of waiting for an ACK
+            bool bNoDelay = false;
+
+            //Kernel send/receive buffer sizes in bytes
+            int nSendBufferSize = 0;
+            int nReceiveBufferSize = 0;
+
+            //Linux only - ACK immediately instead of delaying. The kernel clears
+            //this once we send data, so the connection re-arms it on the first
+            //read after each write
+            bool bQuickAck = false;
+
+            //Let the kernel probe idle connections so dead peers get noticed
+            bool bKeepAlive = false;
+
+            //Linux only - microseconds to busy poll the device queue on blocking reads
+            int nBusyPollMicroseconds = 0;
+
+            //Gather all queued outgoing messages into a single write. Without this,
+            //TCP_NODELAY turns every header and every body into its own syscall/segment
+            bool bCoalesceWrites = false;
+
+            //Upper bound of bytes gathered into one coalesced write. A batch frame
+            //inside it stays within frame::nMaxBatchBodySize either way
+            size_t nMaxCoalescedBytes = 64 * 1024;
+
+            //Pack runs of small queued messages into batch frames (see net_batch.h),
+            //one header and one queue push on the receiver for the whole run.
+            //Every peer decodes batch frames, only the sender has to opt in.
+            //Implies bCoalesceWrites
+            bool bBatchFrames = false;
+
+            //Largest body that still goes into a batch frame
+            size_t nMaxBatchedBodySize = 256;
+
+            //Send a heartbeat every this many milliseconds, 0 - none. Heartbeats
+            //carry timestamps for the round trip / clock offset estimate, see
+            //connection::Timing(). A peer that sends none answers each one
+            uint32_t nHeartbeatMilliseconds = 0;
+
+            //Small interactive messages (e.g. MovePlayer) - no Nagle delay, our own coalescing
+            static socket_options LatencyMode()
+            {
+                socket_options opts;
+                opts.bNoDelay = true;
+                opts.bQuickAck = true;
+                opts.bCoalesceWrites = true;
+                opts.bBatchFrames = true;
+                opts.nHeartbeatMilliseconds = 1000;
+                return opts;
+            }
+
+            //Large transfers - big kernel buffers, leave Nagle on
+            static socket_options BulkMode()
+            {
+                socket_options opts;
+                opts.nSendBufferSize = 4 * 1024 * 1024;
+                opts.nReceiveBufferSize = 4 * 1024 * 1024;
+                opts.bKeepAlive = true;
+                opts.bCoalesceWrites = true;
+                return opts;
+            }
+        };
+
+        //Integer socket option asio has no class for, e.g. for set_option.
+        //Follows asio's SettableSocketOption / GettableSocketOption requirements
+        template<int Level, int Name>
+        class int_socket_option
+        {
+        public:
+            explicit int_socket_option(int nValue = 0)
+                : m_nValue(nValue)
+            {}
+
+            int value() const
+            {
+                return m_nValue;
+            }
+
+            template<typename Protocol>
+            int level(const Protocol&) const
+            {
+                return Level;
+            }
+
+            template<typename Protocol>
+            int name(const Protocol&) const
+            {
+                return Name;
+            }
+
+            template<typename Protocol>
+            int* data(const Protocol&)
+            {
+                return &m_nValue;
+            }
+
+            template<typename Protocol>
+            const int* data(const Protocol&) const
+            {
+                return &m_nValue;
+            }
+
+            template<typename Protocol>
+            size_t size(const Protocol&) const
+            {
+                return sizeof(m_nValue);
+            }
+
+            template<typename Protocol>
+            void resize(const Protocol&, size_t nSize)
+            {
+                if(nSize != sizeof(m_nValue))
+                    throw std::length_error("int_socket_option resize");
+            }
+
+        private:
+            int m_nValue;
+        };
+
+        #if defined(__linux__)
+        typedef int_socket_option<IPPROTO_TCP, TCP_QUICKACK> tcp_quickack;
+        typedef int_socket_option<SOL_SOCKET, SO_BUSY_POLL> socket_busy_poll;
+        #endif
+
+        //TCP only options are skipped on other stream protocols (Unix domain sockets)
+        template<typename Socket>
+        struct is_tcp_socket : std::is_same<typename Socket::protocol_type, asio::ip::tcp> {};
+
+        //Re-arm TCP_QUICKACK, the kernel drops back to delayed ACKs once we send data
+        template<typename Socket>
+        void RefreshQuickAck(Socket& socket, const socket_options& opts)
+        {
+        #if defined(__linux__)
+            if(is_tcp_socket<Socket>::value && opts.bQuickAck)
+            {
+                asio::error_code ec;
+                socket.set_option(tcp_quickack(true), ec);
+            }
+        #endif
+        }
+
+        //Apply the options to an open socket. Failing options are reported and
+        //skipped, a missing tweak is never a reason to drop the connection
+        template<typename Socket>
+        bool ApplySocketOptions(Socket& socket, const socket_options& opts)
+        {
+            bool bAllApplied = true;
+            asio::error_code ec;
+
+            auto check = [&](const char* name)
+            {
+                if(ec)
+                {
+                    Log(log_level::warning, "Unable To Set Socket Option", 0, ec, name);
+                    bAllApplied = false;
+                    ec.clear();
+                }
+            };
+
+            if constexpr(is_tcp_socket<Socket>::value)
+            {
+                if(opts.bNoDelay)
+                {
+                    socket.set_option(asio::ip::tcp::no_delay(true), ec);
+                    check("TCP_NODELAY");
+                }
+            }
+
+            if(opts.nSendBufferSize > 0)
+            {
+                socket.set_option(asio::socket_base::send_buffer_size(opts.nSendBufferSize), ec);
+                check("SO_SNDBUF");
+            }
+
+            if(opts.nReceiveBufferSize > 0)
+            {
+                socket.set_option(asio::socket_base::receive_buffer_size(opts.nReceiveBufferSize), ec);
+                check("SO_RCVBUF");
+            }
+
+            if(is_tcp_socket<Socket>::value && opts.bKeepAlive)
+            {
+                socket.set_option(asio::socket_base::keep_alive(true), ec);
+                check("SO_KEEPALIVE");
+            }
+
+        #if defined(__linux__)
+            if(is_tcp_socket<Socket>::value && opts.bQuickAck)
+            {
+                socket.set_option(tcp_quickack(true), ec);
+                check("TCP_QUICKACK");
+            }
+
+            if(is_tcp_socket<Socket>::value && opts.nBusyPollMicroseconds > 0)
+            {
+                socket.set_option(socket_busy_poll(opts.nBusyPollMicroseconds), ec);
+                check("SO_BUSY_POLL");
+            }
+        #endif
+
+            return bAllApplied;
+        }
+    }
+}
+
+#endif // NET_OPTIONS_H_INCLUDED
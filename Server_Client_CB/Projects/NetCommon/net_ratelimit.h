@@ -0,0 +1,194 @@
+#pragma once
+
+#ifndef NET_RATELIMIT_H_INCLUDED
+#define NET_RATELIMIT_H_INCLUDED
+
+#include "net_common.h"
+
+namespace olc
+{
+    namespace net
+    {
+        /*
+        Example
+        olc::net::rate_limit limits;
+        limits.fMessagesPerSecond = 200;
+        limits.fBytesPerSecond = 64 * 1024;
+        server.SetRateLimit(limits);
+
+        //Ride out reconnect storms - at most 50 new sockets a second, 5000
+        //clients, OnClientConnect run by Update() instead of the asio thread
+        olc::net::admission_control admission;
+        admission.fAcceptsPerSecond = 50;
+        admission.nMaxConnections = 5000;
+        admission.bDeferApproval = true;
+        admission.tPendingTimeout = std::chrono::seconds(5);
+        server.SetAdmissionControl(admission);
+        */
+
+        //Classic token bucket - refills at fRate tokens per second up to fBurst
+        class token_bucket
+        {
+        public:
+            token_bucket(double fRate = 0.0, double fBurst = 0.0)
+            {
+                Reset(fRate, fBurst);
+            }
+
+        public:
+            void Reset(double fRate, double fBurst)
+            {
+                m_fRate = fRate;
+                m_fBurst = fBurst > 0.0 ? fBurst : fRate;
+                m_fTokens = m_fBurst;
+                m_tLast = std::chrono::steady_clock::now();
+            }
+
+            bool Enabled() const
+            {
+                return m_fRate > 0.0;
+            }
+
+            double Burst() const
+            {
+                return m_fBurst;
+            }
+
+            //How long until fCost tokens are available, zero if they are now.
+            //A cost above the burst waits for a full bucket instead of forever
+            std::chrono::steady_clock::duration TimeUntil(double fCost, std::chrono::steady_clock::time_point tNow)
+            {
+                if(!Enabled())
+                    return std::chrono::steady_clock::duration::zero();
+
+                Refill(tNow);
+
+                fCost = std::min(fCost, m_fBurst);
+                if(m_fTokens >= fCost)
+                    return std::chrono::steady_clock::duration::zero();
+
+                return std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::duration<double>((fCost - m_fTokens) / m_fRate));
+            }
+
+            //A cost above the burst leaves the bucket in debt, the
+            //following acquires wait until it is paid back
+            void Consume(double fCost)
+            {
+                if(Enabled())
+                    m_fTokens -= fCost;
+            }
+
+        private:
+            void Refill(std::chrono::steady_clock::time_point tNow)
+            {
+                double fElapsed = std::chrono::duration<double>(tNow - m_tLast).count();
+                m_tLast = tNow;
+                m_fTokens = std::min(m_fBurst, m_fTokens + fElapsed * m_fRate);
+            }
+
+        private:
+            double m_fRate = 0.0;
+            double m_fBurst = 0.0;
+            double m_fTokens = 0.0;
+            std::chrono::steady_clock::time_point m_tLast;
+        };
+
+        //Per connection budget for incoming traffic. A rate of 0 disables that
+        //bucket, a burst of 0 allows one second worth of the rate
+        struct rate_limit
+        {
+            double fMessagesPerSecond = 0.0;
+            double fMessageBurst = 0.0;
+            double fBytesPerSecond = 0.0;
+            double fByteBurst = 0.0;
+
+            bool Enabled() const
+            {
+                return fMessagesPerSecond > 0.0 || fBytesPerSecond > 0.0;
+            }
+        };
+
+        //What the server lets in and when. Zero means unlimited throughout
+        struct admission_control
+        {
+            //Sockets taken off the listen backlog per second. Over the rate the
+            //rest wait in the kernel, costing the asio thread nothing
+            double fAcceptsPerSecond = 0.0;
+            double fAcceptBurst = 0.0;
+
+            //Clients approved or waiting for approval, sockets above it are closed straight away
+            size_t nMaxConnections = 0;
+
+            //Run OnClientConnect from Update() / Tick() instead of the asio thread,
+            //so slow validation never holds up established clients
+            bool bDeferApproval = false;
+
+            //Deferred only - most clients waiting for OnClientConnect, the ones
+            //waiting longer than the timeout are dropped without it
+            size_t nMaxPending = 0;
+            std::chrono::milliseconds tPendingTimeout{0};
+
+            //Deferred only - most OnClientConnect calls per Update() / Tick()
+            size_t nMaxApprovalsPerUpdate = 0;
+        };
+
+        //Both buckets of a connection, a message passes only when both allow it
+        class connection_limiter
+        {
+        public:
+            void Configure(const rate_limit& limits)
+            {
+                m_bucketMessages.Reset(limits.fMessagesPerSecond, limits.fMessageBurst);
+                m_bucketBytes.Reset(limits.fBytesPerSecond, limits.fByteBurst);
+            }
+
+            bool Enabled() const
+            {
+                return m_bucketMessages.Enabled() || m_bucketBytes.Enabled();
+            }
+
+            //Most messages a single acquire can let through without going into debt
+            size_t MaxMessagesPerAcquire() const
+            {
+                if(!m_bucketMessages.Enabled())
+                    return std::numeric_limits<size_t>::max();
+                return std::max<size_t>(1, size_t(m_bucketMessages.Burst()));
+            }
+
+            //Take the tokens for nMessages messages totalling nBytes if available,
+            //otherwise return how long the caller has to wait before trying again
+            std::chrono::steady_clock::duration TryAcquire(size_t nBytes, size_t nMessages = 1)
+            {
+                auto tNow = std::chrono::steady_clock::now();
+                auto tWait = std::max(m_bucketMessages.TimeUntil(double(nMessages), tNow),
+                                      m_bucketBytes.TimeUntil(double(nBytes), tNow));
+
+                if(tWait == std::chrono::steady_clock::duration::zero())
+                {
+                    m_bucketMessages.Consume(double(nMessages));
+                    m_bucketBytes.Consume(double(nBytes));
+                }
+                else
+                {
+                    m_nThrottled++;
+                }
+                return tWait;
+            }
+
+            //Number of times reads were paused
+            uint64_t ThrottledCount() const
+            {
+                return m_nThrottled;
+            }
+
+        private:
+            token_bucket m_bucketMessages;
+            token_bucket m_bucketBytes;
+            //Read by other threads for stats
+            std::atomic<uint64_t> m_nThrottled{0};
+        };
+    }
+}
+
+#endif // NET_RATELIMIT_H_INCLUDED
@@ -0,0 +1,106 @@
+#pragma once
+
+#ifndef NET_SCHEMA_H_INCLUDED
+#define NET_SCHEMA_H_INCLUDED
+
+#include "net_common.h"
+#include "net_message.h"
+#include "net_batch.h"
+
+namespace olc
+{
+    namespace net
+    {
+        /*
+        Example - bound what each message id may carry
+        namespace olc
+        {
+            namespace net
+            {
+                template <>
+                struct message_schema<CustomMsgTypes> : message_schema_defaults
+                {
+                    static constexpr body_size Size(CustomMsgTypes id)
+                    {
+                        switch(id)
+                        {
+                        case CustomMsgTypes::ServerPing:  return body_size::Fixed(sizeof(int64_t));
+                        case CustomMsgTypes::FireBullet:  return body_size::Fixed(2 * sizeof(float));
+                        case CustomMsgTypes::MessageAll:  return body_size::Max(256);
+                        default:                          return body_size::Fixed(0);
+                        }
+                    }
+                };
+            }
+        }
+
+        //A frame breaking the schema closes the connection before its body is
+        //read, so no peer can make a connection buffer more than the largest size
+        */
+
+        //Body size rule for one message id
+        struct body_size
+        {
+            uint32_t nSize;
+            bool bFixed;
+
+            static constexpr body_size Fixed(uint32_t n)
+            {
+                return { n, true };
+            }
+
+            static constexpr body_size Max(uint32_t n)
+            {
+                return { n, false };
+            }
+
+            constexpr bool Allows(uint32_t n) const
+            {
+                return bFixed ? n == nSize : n <= nSize;
+            }
+        };
+
+        //Derive specialisations from this, it switches the checks on and bounds
+        //the frames that are not a single message
+        struct message_schema_defaults
+        {
+            static constexpr bool bEnabled = true;
+
+            //Batch frames are checked as a whole here, every message inside
+            //against its own id. Senders never pack more, a lower bound here
+            //refuses their full batches
+            static constexpr uint32_t nMaxBatchBodySize = frame::nMaxBatchBodySize;
+
+            //Heartbeats and other connection housekeeping
+            static constexpr uint32_t nMaxControlBodySize = 256;
+        };
+
+        //No schema unless specialised for T - bodies take whatever size arrives
+        template <typename T>
+        struct message_schema
+        {
+            static constexpr bool bEnabled = false;
+        };
+
+        //Checked as soon as a header arrives, before anything is allocated for the body
+        template <typename T>
+        bool SchemaAllows(const message_header<T>& header)
+        {
+            if constexpr(message_schema<T>::bEnabled)
+            {
+                uint32_t nBody = frame::BodySize(header);
+                if(frame::IsControl(header))
+                    return nBody <= message_schema<T>::nMaxControlBodySize;
+                if(frame::IsBatch(header))
+                    return nBody <= message_schema<T>::nMaxBatchBodySize;
+                return message_schema<T>::Size(header.id).Allows(nBody);
+            }
+            else
+            {
+                return true;
+            }
+        }
+    }
+}
+
+#endif // NET_SCHEMA_H_INCLUDED
@@ -5,29 +5,69 @@
 #include "net_tsqueue.h"
 #include "net_message.h"
 #include "net_connection.h"
+#include "net_tick.h"
+#include "net_interest.h"
+#include "net_workers.h"
+
+#include <cassert>
+
+#if defined(ASIO_HAS_LOCAL_SOCKETS)
+    #include <sys/stat.h>
+#endif
 
 namespace olc
 {
     namespace net
     {
-        template<typename T>
+        /*
+        Example - same-host clients over a Unix domain socket
+        class SidecarServer : public olc::net::server_interface<CustomMsgTypes, asio::local::stream_protocol>
+        ...
+        SidecarServer server(asio::local::stream_protocol::endpoint("/tmp/game.sock"));
+        */
+
+        //Protocol is the asio stream protocol to listen on, TCP unless stated otherwise
+        template<typename T, typename Protocol = asio::ip::tcp>
         class server_interface
         {
         public:
+            //TCP - listen on every IPv4 interface
             server_interface(uint16_t port)
-                : m_asioAcceptor(m_asioContext, asio::ip::tcp::endpoint(asio::ip::tcp::v4(), port))
+                : m_asioAcceptor(m_asioContext), m_endpoint(asio::ip::tcp::v4(), port), m_tmrAccept(m_asioContext)
             {
+                //Acceptor is only opened in Start(), so that a backend which
+                //cannot run on this machine is reported instead of thrown here
+            }
 
+            //Any endpoint of the protocol, e.g. a socket path for asio::local::stream_protocol
+            server_interface(const typename Protocol::endpoint& endpoint)
+                : m_asioAcceptor(m_asioContext), m_endpoint(endpoint), m_tmrAccept(m_asioContext)
+            {
             }
 
             virtual ~server_interface()
             {
                 Stop();
+
+                //Connections own sockets of m_asioContext, which is declared after
+                //them - release them while the context is still alive
+                m_vDirtyConnections.clear();
+                m_qMessagesIn.clear();
+                m_qPendingClients.clear();
+                m_qApprovedClients.clear();
+                m_deqConnections.clear();
             }
 
             bool Start()
             {
                 try{
+                    m_asioAcceptor.open(m_endpoint.protocol());
+                    if constexpr(std::is_same<Protocol, asio::ip::tcp>::value)
+                        m_asioAcceptor.set_option(asio::socket_base::reuse_address(true));
+                    else
+                        RemoveStaleSocketFile();
+                    m_asioAcceptor.bind(m_endpoint);
+                    m_asioAcceptor.listen();
 
                     WaitForClientConnection();
 
@@ -39,146 +79,674 @@ namespace olc
                     return false;
                 }
 
-                //Too much output will result in decrease in performance
-
-                std::cout << "[SERVER] has started!\n";
+                //Too much output will result in decrease in performance, so the
+                //server logs through the async logger and never blocks on stdout
+                Log(log_level::info, "Server Started", 0, std::error_code(), IoBackendName());
                 return true;
             }
 
+            //Safe to call twice, e.g. by a derived destructor and then this one
             void Stop()
             {
+                if(m_bStopped.exchange(true))
+                    return;
+
+                //Handlers still queued on workers run first, their sends get posted
+                if(m_pWorkers)
+                    m_pWorkers->Stop();
+
                 m_asioContext.stop();
 
                 if(m_threadContext.joinable())
                     m_threadContext.join();
 
-                std::cout << "[SERVER] has stopped!\n";
+                Log(log_level::info, "Server Stopped");
+            }
+
+            //Shut down without losing what is still queued for clients - stop accepting,
+            //wait until every outgoing queue is written or the timeout passes,
+            //half-close every socket and then stop the context.
+            //Returns false if some messages were still pending at the deadline
+            bool Drain(std::chrono::milliseconds tTimeout)
+            {
+                if(!m_threadContext.joinable())
+                {
+                    Stop();
+                    return true;
+                }
+
+                auto tDeadline = std::chrono::steady_clock::now() + tTimeout;
+
+                //Replies from handlers still running on workers belong in the drain
+                WaitForWorkers();
+
+                //Flush anything batched by a tick that never finished
+                for(auto& client : m_vDirtyConnections)
+                    client->FlushSends();
+                m_vDirtyConnections.clear();
+
+                RunOnContext([this]()
+                    {
+                        asio::error_code ec;
+                        m_asioAcceptor.close(ec);
+                    }, tTimeout);
+
+                AdoptApprovedClients();
+
+                //Never approved, nothing was promised to them. Kept alive until
+                //the posted closes have run
+                std::vector<std::shared_ptr<connection<T, Protocol>>> vPending;
+                while(!m_qPendingClients.empty())
+                {
+                    vPending.push_back(m_qPendingClients.pop_front().conn);
+                    vPending.back()->Disconnect();
+                    m_nAdmittedClients--;
+                    m_nRefusedClients++;
+                }
+
+                size_t nConnectionsPending = 0;
+                size_t nMessagesPending = 0;
+                while(true)
+                {
+                    nConnectionsPending = 0;
+                    nMessagesPending = 0;
+                    for(auto& client : m_deqConnections)
+                    {
+                        if(client && client->IsConnected() && client->OutgoingCount() > 0)
+                        {
+                            nConnectionsPending++;
+                            nMessagesPending += client->OutgoingCount();
+                        }
+                    }
+
+                    OnDrainProgress(nConnectionsPending, nMessagesPending);
+
+                    if(nConnectionsPending == 0 || std::chrono::steady_clock::now() >= tDeadline)
+                        break;
+
+                    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+                }
+
+                for(auto& client : m_deqConnections)
+                {
+                    if(client && client->IsConnected())
+                        client->Shutdown();
+                }
+
+                //Shutdowns and closes were posted before this, once it runs they are done
+                RunOnContext([](){}, std::chrono::milliseconds(100));
+
+                if(ShouldLog(log_level::info))
+                {
+                    std::string sDetail = std::to_string(nMessagesPending) + " messages left on "
+                                        + std::to_string(nConnectionsPending) + " connections";
+                    Log(log_level::info, "Server Drained", 0, std::error_code(), sDetail.c_str());
+                }
+
+                Stop();
+                return nConnectionsPending == 0;
+            }
+
+            //Socket tuning for every client accepted from now on
+            void SetSocketOptions(const socket_options& opts)
+            {
+                m_socketOptions = opts;
+            }
+
+            //Incoming traffic budget for every client accepted from now on
+            void SetRateLimit(const rate_limit& limits)
+            {
+                m_rateLimit = limits;
+            }
+
+            //Limits on new clients, see admission_control. Call before Start()
+            void SetAdmissionControl(const admission_control& admission)
+            {
+                m_admission = admission;
+                m_bucketAccepts.Reset(admission.fAcceptsPerSecond, admission.fAcceptBurst);
+            }
+
+            //Clients accepted and waiting for a deferred OnClientConnect
+            size_t PendingClientCount()
+            {
+                return m_qPendingClients.count();
+            }
+
+            //Sockets closed by admission control - over a limit or expired while pending
+            uint64_t RefusedClientCount() const
+            {
+                return m_nRefusedClients;
+            }
+
+            //Run OnMessage on a pool of nThreads workers instead of the thread
+            //calling Update(). Messages of one client are still handled one at a
+            //time and in order, different clients in parallel. 0 turns it off.
+            //Call before Start(). From a worker only use client->Send(), the
+            //MessageClient / MessageAllClients family is for the Update() thread
+            //(asserted in debug builds). Send() stays safe after the client
+            //disconnected, the message keeps its connection alive
+            void SetWorkerThreads(size_t nThreads)
+            {
+                if(m_pWorkers)
+                    m_pWorkers->Stop();
+                m_pWorkers.reset();
+
+                if(nThreads > 0)
+                    m_pWorkers = std::make_unique<worker_pool>(nThreads);
+            }
+
+            //Block until every message handed to the workers has been handled
+            void WaitForWorkers()
+            {
+                if(m_pWorkers)
+                    m_pWorkers->WaitIdle();
             }
 
             //ASYNC - Instruct asio to wait for connection
             void WaitForClientConnection()
             {
+                //Over the accept rate the next socket stays in the listen backlog
+                //until there is a token for it
+                auto tWait = m_bucketAccepts.TimeUntil(1.0, std::chrono::steady_clock::now());
+                if(tWait > std::chrono::steady_clock::duration::zero())
+                {
+                    m_tmrAccept.expires_after(tWait);
+                    m_tmrAccept.async_wait(
+                        [this](std::error_code ec)
+                        {
+                            if(!ec && m_asioAcceptor.is_open())
+                                WaitForClientConnection();
+                        });
+                    return;
+                }
+
                 m_asioAcceptor.async_accept(
-                    [this](std::error_code ec, asio::ip::tcp::socket socket)
+                    [this](std::error_code ec, typename Protocol::socket socket)
                     {
+                        //Acceptor was closed by Drain(), stop listening
+                        if(!m_asioAcceptor.is_open())
+                            return;
+
                         if(!ec)
                         {
+                            m_bucketAccepts.Consume(1.0);
 
-                            std::cout << "[SERVER] New Connection: " << socket.remote_endpoint() << "\n";
-
-                            std::shared_ptr<connection<T>> newconn =
-                                std::make_shared<connection<T>>(connection<T>::owner::server,
-                                    m_asioContext, std::move(socket), m_qMessagesIn);
-
+                            //Formatting the endpoint allocates, only do it if it gets logged
+                            if(ShouldLog(log_level::info))
+                            {
+                                asio::error_code ecEndpoint;
+                                std::ostringstream ss;
+                                ss << socket.remote_endpoint(ecEndpoint);
+                                Log(log_level::info, "New Connection", 0, std::error_code(), ss.str().c_str());
+                            }
 
-                            if(OnClientConnect(newconn))
+                            //Closed as it goes out of scope, before anything was spent on it
+                            if(const char* szReason = AdmissionRefusal())
                             {
-                                m_deqConnections.push_back(std::move(newconn));
+                                m_nRefusedClients++;
+                                Log(log_level::info, "Connection Refused", 0, std::error_code(), szReason);
+                            }
+                            else
+                            {
+                                ApplySocketOptions(socket, m_socketOptions);
 
-                                m_deqConnections.back()->ConnectToClient(nIDCounter++);
+                                std::shared_ptr<connection<T, Protocol>> newconn =
+                                    std::make_shared<connection<T, Protocol>>(connection<T, Protocol>::owner::server,
+                                        m_asioContext, std::move(socket), m_qMessagesIn, m_socketOptions);
 
-                                std::cout << "[" << m_deqConnections.back()->GetID() << "] Connection Approved\n";
-                            }else
-                            {
-                                std::cout << "[-----] Connection Denied\n";
+                                newconn->SetRateLimit(m_rateLimit);
+
+                                m_nAdmittedClients++;
+                                if(m_admission.bDeferApproval)
+                                    m_qPendingClients.push_back({ std::move(newconn), std::chrono::steady_clock::now() });
+                                else
+                                    ApproveClient(std::move(newconn));
                             }
                         }
                         else
                         {
-                            std::cout << "[SERVER] New Connection Error: " << ec.message() << "\n";
+                            Log(log_level::error, "New Connection Failed", 0, ec);
                         }
 
                         WaitForClientConnection();
                     }
                 );
             }
-            //Send message to a specific client
-            void MessageClient(std::shared_ptr<connection<T>> client, const message<T>& msg)
+            //Send message to a specific client, pass an rvalue and the body is never copied
+            void MessageClient(std::shared_ptr<connection<T, Protocol>> client, message<T> msg)
             {
+                AssertUpdateThread();
                 if(client && client->IsConnected())
                 {
-                    client->Send(msg);
+                    SendToClient(client, std::move(msg));
                 }
                 else
                 {
                     OnClientDisconnect(client);
-                    client.reset();
-                    m_deqConnections.erase(
-                        std::remove(m_deqConnections.begin(), m_deqConnections.end(), client), m_deqConnections.end());
+                    ForgetWorkerQueue(client);
+                    EraseConnections(std::remove(m_deqConnections.begin(), m_deqConnections.end(), client));
                 }
             }
 
             //Send message to all clients
-            void MessageAllClients (const message<T>& msg, std::shared_ptr<connection<T>> pIgnoreClient = nullptr)
+            void MessageAllClients (const message<T>& msg, std::shared_ptr<connection<T, Protocol>> pIgnoreClient = nullptr)
             {
+                AssertUpdateThread();
+                //Clients approved since the last Update() hear it too
+                AdoptApprovedClients();
                 bool bInvalidClientExists = false;
                 for(auto& client : m_deqConnections)
                 {
                     if(client && client->IsConnected())
                     {
                         if(client != pIgnoreClient)
-                            client->Send(msg);
+                            SendToClient(client, msg);
                     }
                     else
                     {
                         OnClientDisconnect(client);
+                        ForgetWorkerQueue(client);
                         client.reset();
                         bInvalidClientExists = true;
                     }
                 }
 
                 if(bInvalidClientExists)
-                    m_deqConnections.erase(
-                        std::remove(m_deqConnections.begin(), m_deqConnections.end(), nullptr), m_deqConnections.end());
+                    EraseConnections(std::remove(m_deqConnections.begin(), m_deqConnections.end(), nullptr));
+            }
+
+            //Send message only to clients whose area of interest overlaps the circle at x,y
+            void MessageClientsInArea(const message<T>& msg, const interest_grid<T, Protocol>& interest,
+                                      float x, float y, float fRadius,
+                                      std::shared_ptr<connection<T, Protocol>> pIgnoreClient = nullptr)
+            {
+                AssertUpdateThread();
+                AdoptApprovedClients();
+                std::vector<std::shared_ptr<connection<T, Protocol>>> vInvalidClients;
+
+                interest.Query(x, y, fRadius,
+                    [&](const std::shared_ptr<connection<T, Protocol>>& client)
+                    {
+                        if(client && client->IsConnected())
+                        {
+                            if(client != pIgnoreClient)
+                                SendToClient(client, msg);
+                        }
+                        else
+                        {
+                            vInvalidClients.push_back(client);
+                        }
+                    });
+
+                //Handled after the query, OnClientDisconnect is free to update the grid
+                for(auto& client : vInvalidClients)
+                {
+                    OnClientDisconnect(client);
+                    ForgetWorkerQueue(client);
+                    EraseConnections(std::remove(m_deqConnections.begin(), m_deqConnections.end(), client));
+                }
             }
 
             //Allow users manually invoke message queue to update
             void Update(size_t nMaxMessages = -1)
             {
+                m_idUpdateThread = std::this_thread::get_id();
+                ApprovePendingClients();
+                SweepClosedConnections();
+                OnUpdate();
+
                 size_t nMessageCount = 0;
                 while(nMessageCount < nMaxMessages && !m_qMessagesIn.empty())
                 {
                     //Grab the front message
                     auto msg = m_qMessagesIn.pop_front();
 
-                    OnMessage(msg.remote, msg.msg);
+                    HandleMessage(std::move(msg));
 
                     nMessageCount++;
                 }
             }
 
+            //Run the server loop at the scheduler's fixed rate until it is stopped
+            void RunTicks(tick_scheduler& scheduler)
+            {
+                while(scheduler.IsRunning())
+                {
+                    uint64_t nTick = scheduler.WaitForNextTick();
+                    Tick(nTick, scheduler.MessageBudget());
+                }
+            }
+
+            //One server tick - handle incoming messages until the budget runs out,
+            //let the user update the world, then flush every send made during the
+            //tick with one post per connection instead of one post per message
+            size_t Tick(uint64_t nTick, std::chrono::microseconds budget)
+            {
+                auto tDeadline = std::chrono::steady_clock::now() + budget;
+                size_t nMessageCount = 0;
+                m_idUpdateThread = std::this_thread::get_id();
+
+                ApprovePendingClients();
+                SweepClosedConnections();
+                OnUpdate();
+
+                //Handlers on workers send straight away, QueueSend is not thread safe
+                m_bInTick = !m_pWorkers;
+
+                while(!m_qMessagesIn.empty() && std::chrono::steady_clock::now() < tDeadline)
+                {
+                    auto msg = m_qMessagesIn.pop_front();
+
+                    HandleMessage(std::move(msg));
+
+                    nMessageCount++;
+                }
+
+                //OnTick never runs next to a handler. Handlers not started by the
+                //deadline stay queued and run after this tick, the running ones
+                //are finished first
+                if(m_pWorkers)
+                {
+                    if(!m_pWorkers->WaitIdleUntil(tDeadline))
+                        m_pWorkers->Pause();
+                    m_bInTick = true;
+                }
+
+                OnTick(nTick);
+
+                m_bInTick = false;
+
+                for(auto& client : m_vDirtyConnections)
+                    client->FlushSends();
+                m_vDirtyConnections.clear();
+
+                if(m_pWorkers)
+                    m_pWorkers->Resume();
+
+                return nMessageCount;
+            }
+
         protected:
             //Called when a client connects, you can veto the connection by returning false
-            virtual bool OnClientConnect(std::shared_ptr<connection<T>> client)
+            virtual bool OnClientConnect(std::shared_ptr<connection<T, Protocol>> client)
             {
                 return false;
             }
 
             // Called when a client appears to have disconnected
-            virtual void OnClientDisconnect(std::shared_ptr<connection<T>> client)
+            virtual void OnClientDisconnect(std::shared_ptr<connection<T, Protocol>> client)
             {
 
             }
 
             // Called when a message is received
-            virtual void OnMessage(std::shared_ptr<connection<T>> client, message<T>& msg)
+            virtual void OnMessage(std::shared_ptr<connection<T, Protocol>> client, message<T>& msg)
+            {
+
+            }
+
+            // Called once per tick by Tick(), after the tick's messages were handled
+            virtual void OnTick(uint64_t nTick)
+            {
+
+            }
+
+            // Called at the start of every Update() and Tick(), on the thread running them.
+            // Servers layered on top (e.g. cluster_server) do their housekeeping here,
+            // call the base version when overriding one of those
+            virtual void OnUpdate()
+            {
+
+            }
+
+            // Called by Drain() while it waits, with what is still left to send
+            virtual void OnDrainProgress(size_t nConnectionsPending, size_t nMessagesPending)
+            {
+
+            }
+
+        private:
+            //A Unix domain socket path left behind by a previous run makes bind()
+            //fail. Only a socket nobody listens on is removed - a regular file, or
+            //the socket of a server still running, is left for bind() to report.
+            //Only called for non-TCP protocols
+            void RemoveStaleSocketFile()
+            {
+            #if defined(ASIO_HAS_LOCAL_SOCKETS)
+                if constexpr(std::is_same<Protocol, asio::local::stream_protocol>::value)
+                {
+                    struct stat info;
+                    if(m_endpoint.path().empty() || stat(m_endpoint.path().c_str(), &info) != 0 || !S_ISSOCK(info.st_mode))
+                        return;
+
+                    asio::error_code ec;
+                    typename Protocol::socket probe(m_asioContext);
+                    probe.connect(m_endpoint, ec);
+                    if(ec == asio::error::connection_refused)
+                        std::remove(m_endpoint.path().c_str());
+                }
+            #endif
+            }
+
+            //Run fn on the context thread and wait for it, up to tTimeout
+            template <typename Func>
+            bool RunOnContext(Func fn, std::chrono::milliseconds tTimeout)
+            {
+                auto done = std::make_shared<std::promise<void>>();
+                auto future = done->get_future();
+                asio::post(m_asioContext, [fn, done]() { fn(); done->set_value(); });
+                return future.wait_for(tTimeout) == std::future_status::ready;
+            }
+
+            //On the calling thread, or on a worker queued behind the client's earlier messages
+            void HandleMessage(owned_message<T, Protocol>&& msg)
+            {
+                if(!m_pWorkers)
+                {
+                    OnMessage(msg.remote, msg.msg);
+                    return;
+                }
+
+                uint32_t nID = msg.remote ? msg.remote->GetID() : 0;
+                m_pWorkers->Dispatch(nID, [this, msg = std::move(msg)]() mutable { OnMessage(msg.remote, msg.msg); });
+            }
+
+            //The MessageClient family owns m_deqConnections together with Update() /
+            //Tick(), from a worker only client->Send() is safe
+            void AssertUpdateThread() const
+            {
+                assert(!worker_pool::OnWorkerThread() && "MessageClient family called from a worker");
+                assert((m_idUpdateThread.load() == std::thread::id() || m_idUpdateThread.load() == std::this_thread::get_id())
+                       && "MessageClient family called off the Update thread");
+            }
+
+            //Why a socket just accepted must be closed, nullptr if it may stay
+            const char* AdmissionRefusal()
+            {
+                if(m_admission.nMaxConnections > 0 && m_nAdmittedClients >= m_admission.nMaxConnections)
+                    return "server full";
+                if(m_admission.bDeferApproval && m_admission.nMaxPending > 0
+                    && m_qPendingClients.count() >= m_admission.nMaxPending)
+                    return "approval queue full";
+                return nullptr;
+            }
+
+            //OnClientConnect and, if it agrees, start reading. Counted as admitted already.
+            //m_deqConnections belongs to the Update thread, the client joins it there
+            void ApproveClient(std::shared_ptr<connection<T, Protocol>> newconn)
+            {
+                if(OnClientConnect(newconn))
+                {
+                    newconn->ConnectToClient(nIDCounter++);
+
+                    Log(log_level::info, "Connection Approved", newconn->GetID());
+
+                    m_qApprovedClients.push_back(std::move(newconn));
+                }else
+                {
+                    m_nAdmittedClients--;
+                    Log(log_level::info, "Connection Denied");
+                }
+            }
+
+            //Deferred OnClientConnect, on the thread running Update() / Tick().
+            //The sockets are not read before this, anything sent waits in the kernel
+            void ApprovePendingClients()
+            {
+                auto tNow = std::chrono::steady_clock::now();
+                size_t nApproved = 0;
+                while(!m_qPendingClients.empty())
+                {
+                    if(m_admission.nMaxApprovalsPerUpdate > 0 && nApproved >= m_admission.nMaxApprovalsPerUpdate)
+                        break;
+
+                    auto pending = m_qPendingClients.pop_front();
+
+                    //Most likely given up by now, dropping it is cheaper than validating it
+                    if(m_admission.tPendingTimeout.count() > 0 && tNow - pending.tAccepted > m_admission.tPendingTimeout)
+                    {
+                        m_nAdmittedClients--;
+                        m_nRefusedClients++;
+                        Log(log_level::info, "Connection Refused", 0, std::error_code(), "approval timed out");
+                        continue;
+                    }
+
+                    ApproveClient(std::move(pending.conn));
+                    nApproved++;
+                }
+
+                AdoptApprovedClients();
+            }
+
+            //Approved on the asio thread, joining on the Update thread
+            void AdoptApprovedClients()
+            {
+                while(!m_qApprovedClients.empty())
+                    m_deqConnections.push_back(m_qApprovedClients.pop_front());
+            }
+
+            //A closed socket gives its admission slot back here, not only once a send
+            //to it fails. Rate limited, it is a pass over every connection
+            void SweepClosedConnections()
+            {
+                auto tNow = std::chrono::steady_clock::now();
+                if(tNow - m_tLastSweep < tSweepInterval)
+                    return;
+                m_tLastSweep = tNow;
+
+                std::vector<std::shared_ptr<connection<T, Protocol>>> vClosed;
+                for(auto& client : m_deqConnections)
+                {
+                    if(client && !client->IsConnected())
+                        vClosed.push_back(std::move(client));
+                }
+
+                if(vClosed.empty())
+                    return;
+
+                //Erased first, OnClientDisconnect is free to message the others
+                EraseConnections(std::remove(m_deqConnections.begin(), m_deqConnections.end(), nullptr));
+                for(auto& client : vClosed)
+                {
+                    OnClientDisconnect(client);
+                    ForgetWorkerQueue(client);
+                }
+
+                //The asio thread closed them and may still be in one of their
+                //handlers, the last references go there too
+                asio::post(m_asioContext, [vClosed = std::move(vClosed)]() {});
+            }
+
+            //Erase what std::remove left at the back, those clients no longer count as admitted
+            void EraseConnections(typename std::deque<std::shared_ptr<connection<T, Protocol>>>::iterator itFirst)
             {
+                m_nAdmittedClients -= size_t(std::distance(itFirst, m_deqConnections.end()));
+                m_deqConnections.erase(itFirst, m_deqConnections.end());
+            }
+
+            //Called after OnClientDisconnect, the client's worker queue is not needed anymore
+            void ForgetWorkerQueue(const std::shared_ptr<connection<T, Protocol>>& client)
+            {
+                if(m_pWorkers && client)
+                    m_pWorkers->Forget(client->GetID());
+            }
 
+            //Inside a tick sends are held per connection until the tick ends.
+            //Broadcasts copy into msg once per client, after that it is only moved
+            void SendToClient(const std::shared_ptr<connection<T, Protocol>>& client, message<T> msg)
+            {
+                if(m_bInTick)
+                {
+                    if(client->QueueSend(std::move(msg)))
+                        m_vDirtyConnections.push_back(client);
+                }
+                else
+                {
+                    client->Send(std::move(msg));
+                }
             }
 
         protected:
             //Thread safe queue for incoming message packets
-            tsqueue<owned_message<T>> m_qMessagesIn;
+            tsqueue<owned_message<T, Protocol>> m_qMessagesIn;
 
             //Container of active connections
-            std::deque<std::shared_ptr<connection<T>>> m_deqConnections;
+            std::deque<std::shared_ptr<connection<T, Protocol>>> m_deqConnections;
 
             //Order of declaration is impt - it is also order of init
             asio::io_context m_asioContext;
             std::thread m_threadContext;
+            std::atomic<bool> m_bStopped{false};
 
             //These things need an asio context
-            asio::ip::tcp::acceptor m_asioAcceptor;
+            typename Protocol::acceptor m_asioAcceptor;
+            typename Protocol::endpoint m_endpoint;
+
+            //Holds off the next accept while over the accept rate
+            asio::steady_timer m_tmrAccept;
+
+            //Set while Tick() runs, sends are batched instead of posted
+            bool m_bInTick = false;
+
+            //Connections holding batched sends for the current tick
+            std::vector<std::shared_ptr<connection<T, Protocol>>> m_vDirtyConnections;
+
+            //Applied to each accepted socket
+            socket_options m_socketOptions;
+
+            //Applied to each accepted connection
+            rate_limit m_rateLimit;
+
+            //Limits on new clients, see SetAdmissionControl()
+            admission_control m_admission;
+
+            //Only touched by the asio thread
+            token_bucket m_bucketAccepts;
+
+            //Accepted clients waiting for a deferred OnClientConnect
+            struct pending_client
+            {
+                std::shared_ptr<connection<T, Protocol>> conn;
+                std::chrono::steady_clock::time_point tAccepted;
+            };
+            tsqueue<pending_client> m_qPendingClients;
+
+            //Approved, on their way into m_deqConnections
+            tsqueue<std::shared_ptr<connection<T, Protocol>>> m_qApprovedClients;
+
+            //Approved plus pending, what nMaxConnections is checked against
+            std::atomic<size_t> m_nAdmittedClients{0};
+            std::atomic<uint64_t> m_nRefusedClients{0};
+
+            //See SweepClosedConnections()
+            static constexpr std::chrono::milliseconds tSweepInterval{100};
+            std::chrono::steady_clock::time_point m_tLastSweep;
+
+            //Optional OnMessage workers, see SetWorkerThreads()
+            std::unique_ptr<worker_pool> m_pWorkers;
+
+            //Last thread to run Update() / Tick()
+            std::atomic<std::thread::id> m_idUpdateThread{};
 
             //Clients will be identified in the 'wider systems' via an ID
             uint32_t nIDCounter = 10000;
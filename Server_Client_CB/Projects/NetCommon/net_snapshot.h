@@ -0,0 +1,357 @@
+#pragma once
+
+#ifndef NET_SNAPSHOT_H_INCLUDED
+#define NET_SNAPSHOT_H_INCLUDED
+
+#include "net_common.h"
+#include "net_message.h"
+
+#include <unordered_map>
+
+namespace olc
+{
+    namespace net
+    {
+        /*
+        Example - server, each tick
+        olc::net::snapshot_replicator<CustomMsgTypes> replicator(CustomMsgTypes::WorldSnapshot);
+
+        replicator.Capture(worldState);
+        //A copy, MessageClient erases disconnected clients from the deque
+        auto vClients = m_deqConnections;
+        for(auto& client : vClients)
+            MessageClient(client, replicator.BuildFor(client->GetID()));
+
+        //In OnMessage, for CustomMsgTypes::SnapshotAck
+        replicator.Acknowledge(client->GetID(), msg);
+
+        Example - client
+        olc::net::snapshot_receiver<CustomMsgTypes> receiver(32, sizeof(worldState));
+        if(receiver.Apply(msg))
+        {
+            receiver.Read(worldState);
+            Send(receiver.MakeAck(CustomMsgTypes::SnapshotAck));
+        }
+        */
+
+        //Leads every snapshot message body
+        struct snapshot_header
+        {
+            uint32_t nSequence;
+            //Sequence the delta was made against, 0 means the body is a full snapshot
+            uint32_t nBaseline;
+            //Size of the decoded snapshot in bytes
+            uint32_t nLength;
+        };
+
+        //Delta encoding shared by both sides. The current snapshot is XORed against
+        //the baseline so unchanged bytes become zero, then written as runs of
+        //<varint zeros><varint literal count><literal bytes>.
+        //A steady state world mostly turns into a handful of zero runs
+        namespace snapshot_codec
+        {
+            inline void PutVarint(std::vector<uint8_t>& out, uint32_t n)
+            {
+                while(n >= 0x80)
+                {
+                    out.push_back(uint8_t(n | 0x80));
+                    n >>= 7;
+                }
+                out.push_back(uint8_t(n));
+            }
+
+            inline bool GetVarint(const uint8_t*& p, const uint8_t* end, uint32_t& n)
+            {
+                n = 0;
+                for(int shift = 0; shift < 35 && p < end; shift += 7)
+                {
+                    uint8_t b = *p++;
+                    n |= uint32_t(b & 0x7F) << shift;
+                    if(!(b & 0x80))
+                        return true;
+                }
+                return false;
+            }
+
+            inline uint8_t BaseByte(const std::vector<uint8_t>& base, size_t i)
+            {
+                return i < base.size() ? base[i] : 0;
+            }
+
+            //An empty baseline encodes a full snapshot with the same format
+            inline void Encode(const std::vector<uint8_t>& base, const std::vector<uint8_t>& cur, std::vector<uint8_t>& out)
+            {
+                size_t i = 0;
+                while(i < cur.size())
+                {
+                    size_t nZeros = 0;
+                    while(i + nZeros < cur.size() && cur[i + nZeros] == BaseByte(base, i + nZeros))
+                        nZeros++;
+
+                    size_t nLiteral = 0;
+                    //Short matches inside a literal run are cheaper kept as literals
+                    size_t nMatch = 0;
+                    while(i + nZeros + nLiteral + nMatch < cur.size())
+                    {
+                        size_t j = i + nZeros + nLiteral + nMatch;
+                        if(cur[j] == BaseByte(base, j))
+                        {
+                            if(++nMatch > 2)
+                                break;
+                        }
+                        else
+                        {
+                            nLiteral += nMatch + 1;
+                            nMatch = 0;
+                        }
+                    }
+
+                    //Trailing unchanged bytes are implied by the length
+                    if(nLiteral == 0)
+                        break;
+
+                    PutVarint(out, uint32_t(nZeros));
+                    PutVarint(out, uint32_t(nLiteral));
+                    for(size_t j = i + nZeros; j < i + nZeros + nLiteral; j++)
+                        out.push_back(cur[j] ^ BaseByte(base, j));
+
+                    i += nZeros + nLiteral;
+                }
+            }
+
+            inline bool Decode(const std::vector<uint8_t>& base, const uint8_t* p, const uint8_t* end,
+                               uint32_t nLength, std::vector<uint8_t>& out)
+            {
+                out.resize(nLength);
+                size_t i = 0;
+                while(p < end)
+                {
+                    uint32_t nZeros, nLiteral;
+                    if(!GetVarint(p, end, nZeros) || !GetVarint(p, end, nLiteral))
+                        return false;
+                    if(i + nZeros + nLiteral > nLength || size_t(end - p) < nLiteral)
+                        return false;
+
+                    for(size_t j = i; j < i + nZeros; j++)
+                        out[j] = BaseByte(base, j);
+                    i += nZeros;
+
+                    for(size_t j = i; j < i + nLiteral; j++)
+                        out[j] = *p++ ^ BaseByte(base, j);
+                    i += nLiteral;
+                }
+
+                //Trailing bytes equal to the baseline need no run at all
+                for(; i < nLength; i++)
+                    out[i] = BaseByte(base, i);
+                return true;
+            }
+        }
+
+        //Server side - keeps a short history of snapshots and, per client, the last
+        //one it acknowledged. Each client gets a delta against its own baseline
+        template <typename T>
+        class snapshot_replicator
+        {
+        public:
+            snapshot_replicator(T snapshotId, size_t nHistory = 32)
+                : m_snapshotId(snapshotId), m_vHistory(nHistory == 0 ? 1 : nHistory)
+            {}
+
+        public:
+            //Record the state for this tick and return its sequence number
+            uint32_t Capture(const std::vector<uint8_t>& state)
+            {
+                m_nSequence++;
+                auto& slot = m_vHistory[m_nSequence % m_vHistory.size()];
+                slot.nSequence = m_nSequence;
+                slot.data = state;
+                return m_nSequence;
+            }
+
+            //Any POD-like state can be captured directly
+            template <typename DataType,
+                      typename = typename std::enable_if<std::is_trivially_copyable<DataType>::value>::type>
+            uint32_t Capture(const DataType& state)
+            {
+                const uint8_t* p = reinterpret_cast<const uint8_t*>(&state);
+                return Capture(std::vector<uint8_t>(p, p + sizeof(DataType)));
+            }
+
+            //Build the message carrying the latest capture for this client. Falls back
+            //to a full snapshot when the client has not acknowledged anything we still hold
+            message<T> BuildFor(uint32_t nClientID)
+            {
+                const auto& current = m_vHistory[m_nSequence % m_vHistory.size()];
+
+                snapshot_header sh{};
+                sh.nSequence = current.nSequence;
+                sh.nLength = uint32_t(current.data.size());
+
+                static const std::vector<uint8_t> empty;
+                const std::vector<uint8_t>* base = &empty;
+
+                auto it = m_mapAcked.find(nClientID);
+                if(it != m_mapAcked.end())
+                {
+                    const auto& slot = m_vHistory[it->second % m_vHistory.size()];
+                    if(slot.nSequence == it->second && it->second != 0)
+                    {
+                        sh.nBaseline = it->second;
+                        base = &slot.data;
+                    }
+                }
+
+                m_vScratch.clear();
+                snapshot_codec::Encode(*base, current.data, m_vScratch);
+
+                message<T> msg;
+                msg.header.id = m_snapshotId;
+                msg.body.resize(sizeof(snapshot_header) + m_vScratch.size());
+                std::memcpy(msg.body.data(), &sh, sizeof(snapshot_header));
+                if(!m_vScratch.empty())
+                    std::memcpy(msg.body.data() + sizeof(snapshot_header), m_vScratch.data(), m_vScratch.size());
+                msg.header.size = msg.body.size();
+                return msg;
+            }
+
+            void Acknowledge(uint32_t nClientID, uint32_t nSequence)
+            {
+                //Acks can arrive out of order, never move a baseline backwards
+                uint32_t& nAcked = m_mapAcked[nClientID];
+                if(nSequence > nAcked && nSequence <= m_nSequence)
+                    nAcked = nSequence;
+            }
+
+            //Acknowledge straight from the ack message made by snapshot_receiver::MakeAck
+            void Acknowledge(uint32_t nClientID, message<T>& msg)
+            {
+                uint32_t nSequence = 0;
+                if(msg.body.size() >= sizeof(uint32_t))
+                {
+                    msg >> nSequence;
+                    Acknowledge(nClientID, nSequence);
+                }
+            }
+
+            //Drop the client's baseline, e.g. in OnClientDisconnect
+            void Forget(uint32_t nClientID)
+            {
+                m_mapAcked.erase(nClientID);
+            }
+
+            uint32_t LatestSequence() const
+            {
+                return m_nSequence;
+            }
+
+        private:
+            struct snapshot
+            {
+                uint32_t nSequence = 0;
+                std::vector<uint8_t> data;
+            };
+
+            T m_snapshotId;
+            uint32_t m_nSequence = 0;
+            std::vector<snapshot> m_vHistory;
+            std::unordered_map<uint32_t, uint32_t> m_mapAcked;
+            std::vector<uint8_t> m_vScratch;
+        };
+
+        //Client side - rebuilds snapshots from the deltas and remembers recent ones
+        //so any baseline the server may pick is still available
+        template <typename T>
+        class snapshot_receiver
+        {
+        public:
+            //nMaxLength bounds the decoded size, the length field comes off the
+            //wire and is not trusted with an allocation of its own
+            snapshot_receiver(size_t nHistory = 32, size_t nMaxLength = 1024 * 1024)
+                : m_vHistory(nHistory == 0 ? 1 : nHistory), m_nMaxLength(nMaxLength)
+            {}
+
+        public:
+            //Decode a snapshot message. Returns false for stale, corrupt or
+            //undecodable snapshots, the current state is left untouched then
+            bool Apply(const message<T>& msg)
+            {
+                if(msg.body.size() < sizeof(snapshot_header))
+                    return false;
+
+                snapshot_header sh{};
+                std::memcpy(&sh, msg.body.data(), sizeof(snapshot_header));
+
+                if(sh.nSequence <= m_nLatest || sh.nLength > m_nMaxLength)
+                    return false;
+
+                static const std::vector<uint8_t> empty;
+                const std::vector<uint8_t>* base = &empty;
+                if(sh.nBaseline != 0)
+                {
+                    const auto& slot = m_vHistory[sh.nBaseline % m_vHistory.size()];
+                    if(slot.nSequence != sh.nBaseline)
+                        return false;
+                    base = &slot.data;
+                }
+
+                const uint8_t* p = reinterpret_cast<const uint8_t*>(msg.body.data()) + sizeof(snapshot_header);
+                const uint8_t* end = reinterpret_cast<const uint8_t*>(msg.body.data()) + msg.body.size();
+
+                if(!snapshot_codec::Decode(*base, p, end, sh.nLength, m_vDecoded))
+                    return false;
+
+                auto& slot = m_vHistory[sh.nSequence % m_vHistory.size()];
+                slot.nSequence = sh.nSequence;
+                slot.data.swap(m_vDecoded);
+                m_nLatest = sh.nSequence;
+                return true;
+            }
+
+            const std::vector<uint8_t>& Current() const
+            {
+                return m_vHistory[m_nLatest % m_vHistory.size()].data;
+            }
+
+            //Copy the current snapshot into a POD-like state
+            template <typename DataType>
+            bool Read(DataType& state) const
+            {
+                static_assert(std::is_standard_layout<DataType>::value, "Data is too complex");
+                const auto& cur = Current();
+                if(cur.size() != sizeof(DataType))
+                    return false;
+                std::memcpy(&state, cur.data(), sizeof(DataType));
+                return true;
+            }
+
+            uint32_t LatestSequence() const
+            {
+                return m_nLatest;
+            }
+
+            //Ack for the latest decoded snapshot, to be sent back to the server
+            message<T> MakeAck(T ackId) const
+            {
+                message<T> msg;
+                msg.header.id = ackId;
+                msg << m_nLatest;
+                return msg;
+            }
+
+        private:
+            struct snapshot
+            {
+                uint32_t nSequence = 0;
+                std::vector<uint8_t> data;
+            };
+
+            uint32_t m_nLatest = 0;
+            std::vector<snapshot> m_vHistory;
+            size_t m_nMaxLength;
+            std::vector<uint8_t> m_vDecoded;
+        };
+    }
+}
+
+#endif // NET_SNAPSHOT_H_INCLUDED
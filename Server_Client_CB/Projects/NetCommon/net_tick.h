@@ -0,0 +1,115 @@
+#pragma once
+
+#ifndef NET_TICK_H_INCLUDED
+#define NET_TICK_H_INCLUDED
+
+#include "net_common.h"
+
+namespace olc
+{
+    namespace net
+    {
+        /*
+        Example
+        CustomServer server(60000);
+        server.Start();
+
+        //30 ticks a second, at most 10ms of each tick spent in OnMessage
+        olc::net::tick_scheduler ticker(30, std::chrono::milliseconds(10));
+        server.RunTicks(ticker);
+        */
+
+        //Keeps a fixed tick rate for a server loop. Each tick has a time budget
+        //for message processing, whatever is left over waits for the next tick
+        class tick_scheduler
+        {
+        public:
+            //A budget of 0 gives half of the tick interval to message processing
+            tick_scheduler(uint32_t nTicksPerSecond = 30,
+                           std::chrono::microseconds budget = std::chrono::microseconds(0))
+            {
+                SetRate(nTicksPerSecond, budget);
+            }
+
+        public:
+            void SetRate(uint32_t nTicksPerSecond, std::chrono::microseconds budget = std::chrono::microseconds(0))
+            {
+                if(nTicksPerSecond == 0)
+                    nTicksPerSecond = 1;
+
+                m_tInterval = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                    std::chrono::seconds(1)) / nTicksPerSecond;
+
+                if(budget.count() > 0)
+                    m_tBudget = budget;
+                else
+                    m_tBudget = std::chrono::duration_cast<std::chrono::microseconds>(m_tInterval / 2);
+            }
+
+            std::chrono::steady_clock::duration TickInterval() const
+            {
+                return m_tInterval;
+            }
+
+            std::chrono::microseconds MessageBudget() const
+            {
+                return m_tBudget;
+            }
+
+            //Sleep until the next tick is due and return its number. When we have
+            //fallen more than a tick behind, the missed ticks are skipped instead of
+            //run back to back, a late server should not burst
+            uint64_t WaitForNextTick()
+            {
+                auto tNow = std::chrono::steady_clock::now();
+
+                if(m_nTick == 0)
+                    m_tNextTick = tNow;
+                else if(tNow > m_tNextTick + m_tInterval)
+                {
+                    m_nSkippedTicks += (tNow - m_tNextTick) / m_tInterval;
+                    m_tNextTick = tNow;
+                }
+                else if(tNow < m_tNextTick)
+                    std::this_thread::sleep_until(m_tNextTick);
+
+                m_tNextTick += m_tInterval;
+                return m_nTick++;
+            }
+
+            //May be called from any thread, RunTicks() returns after the current tick
+            void Stop()
+            {
+                m_bRunning = false;
+            }
+
+            bool IsRunning() const
+            {
+                return m_bRunning;
+            }
+
+            uint64_t TickCount() const
+            {
+                return m_nTick;
+            }
+
+            //Number of ticks dropped because the loop could not keep up
+            uint64_t SkippedTicks() const
+            {
+                return m_nSkippedTicks;
+            }
+
+        private:
+            std::chrono::steady_clock::duration m_tInterval;
+            std::chrono::microseconds m_tBudget;
+            std::chrono::steady_clock::time_point m_tNextTick;
+
+            uint64_t m_nTick = 0;
+            uint64_t m_nSkippedTicks = 0;
+
+            std::atomic<bool> m_bRunning{true};
+        };
+    }
+}
+
+#endif // NET_TICK_H_INCLUDED
@@ -4,6 +4,9 @@
 #define NET_TSQUEUE_H_INCLUDED
 #include "net_common.h"
 
+#include <condition_variable>
+#include <functional>
+
 namespace olc
 {
     namespace net
@@ -50,15 +53,78 @@ namespace olc
             //Add item to the front of the Queue
             void push_front(const T& item)
             {
-                std::scoped_lock lock(muxQueue);
-                return deqQueue.emplace_front(std::move(item));
+                {
+                    std::scoped_lock lock(muxQueue);
+                    deqQueue.emplace_front(std::move(item));
+                }
+                signal();
+            }
+
+            //Move item to the front of the Queue
+            void push_front(T&& item)
+            {
+                {
+                    std::scoped_lock lock(muxQueue);
+                    deqQueue.emplace_front(std::move(item));
+                }
+                signal();
             }
 
             //Add item to the back of the Queue
             void push_back(const T& item)
             {
-                std::scoped_lock lock(muxQueue);
-                return deqQueue.emplace_back(std::move(item));
+                {
+                    std::scoped_lock lock(muxQueue);
+                    deqQueue.emplace_back(std::move(item));
+                }
+                signal();
+            }
+
+            //Move item to the back of the Queue
+            void push_back(T&& item)
+            {
+                {
+                    std::scoped_lock lock(muxQueue);
+                    deqQueue.emplace_back(std::move(item));
+                }
+                signal();
+            }
+
+            //Move a range of items to the back of the Queue under a single lock
+            template<typename Iterator>
+            void push_back_range(Iterator first, Iterator last)
+            {
+                if(first == last)
+                    return;
+
+                {
+                    std::scoped_lock lock(muxQueue);
+                    for(; first != last; ++first)
+                        deqQueue.emplace_back(std::move(*first));
+                }
+                signal();
+            }
+
+            //Block until the queue has something in it
+            void wait()
+            {
+                std::unique_lock<std::mutex> lock(muxQueue);
+                cvBlocking.wait(lock, [this]() { return !deqQueue.empty(); });
+            }
+
+            //Block until the queue has something in it or the timeout passes,
+            //returns false on timeout
+            bool wait_for(std::chrono::milliseconds timeout)
+            {
+                std::unique_lock<std::mutex> lock(muxQueue);
+                return cvBlocking.wait_for(lock, timeout, [this]() { return !deqQueue.empty(); });
+            }
+
+            //Called after every push, on the pushing thread and outside the lock.
+            //Set it before anything pushes, it is not guarded
+            void set_notifier(std::function<void()> fn)
+            {
+                fnNotify = std::move(fn);
             }
 
             //Clear the queue
@@ -83,9 +149,19 @@ namespace olc
             }
 
 
+        protected:
+            void signal()
+            {
+                cvBlocking.notify_all();
+                if(fnNotify)
+                    fnNotify();
+            }
+
         protected:
             std::mutex muxQueue;
             std::deque<T> deqQueue;
+            std::condition_variable cvBlocking;
+            std::function<void()> fnNotify;
         };
     }
 }
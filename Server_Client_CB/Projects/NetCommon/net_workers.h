@@ -0,0 +1,417 @@
+#pragma once
+
+#ifndef NET_WORKERS_H_INCLUDED
+#define NET_WORKERS_H_INCLUDED
+
+#include "net_common.h"
+#include "net_log.h"
+
+#include <functional>
+#include <unordered_map>
+#include <condition_variable>
+
+namespace olc
+{
+    namespace net
+    {
+        /*
+        Example
+        olc::net::worker_pool workers(4);
+
+        //Tasks with the same key run one at a time and in dispatch order,
+        //tasks with different keys run in parallel
+        workers.Dispatch(client->GetID(), [msg]() { ... });
+
+        //Block until everything dispatched so far has run
+        workers.WaitIdle();
+        */
+
+        //Thread pool for tasks that must stay ordered per key (per connection).
+        //Each key has its own serial queue, a queue is handed to at most one
+        //worker at a time. Ready queues sit in per-worker deques, a worker with
+        //nothing to do steals from the others
+        class worker_pool
+        {
+        public:
+            //0 threads - one per hardware thread
+            worker_pool(size_t nThreads = 0)
+            {
+                if(nThreads == 0)
+                    nThreads = std::max(1u, std::thread::hardware_concurrency());
+
+                for(size_t i = 0; i < nThreads; i++)
+                    m_vWorkers.push_back(std::make_unique<worker>());
+
+                for(size_t i = 0; i < nThreads; i++)
+                    m_vThreads.emplace_back([this, i]() { WorkerLoop(i); });
+            }
+
+            worker_pool(const worker_pool&) = delete;
+
+            ~worker_pool()
+            {
+                Stop();
+            }
+
+        public:
+            //Queue task behind everything already dispatched with the same key
+            void Dispatch(uint32_t nKey, std::function<void()> task)
+            {
+                if(!m_bRunning)
+                {
+                    //Nobody left to run it, at least keep the order
+                    RunTask(task);
+                    return;
+                }
+
+                std::shared_ptr<serial_queue> queue;
+                bool bSchedule = false;
+                {
+                    //Queued under the map lock too, a forgotten queue is only
+                    //dropped while both locks show it idle
+                    std::scoped_lock lock(m_muxQueues);
+                    auto& entry = m_mapQueues[nKey];
+                    if(!entry)
+                    {
+                        entry = std::make_shared<serial_queue>();
+                        entry->nKey = nKey;
+                    }
+                    queue = entry;
+
+                    m_nPending++;
+
+                    std::scoped_lock lockQueue(queue->mux);
+                    queue->deqTasks.push_back(std::move(task));
+                    if(!queue->bScheduled)
+                    {
+                        queue->bScheduled = true;
+                        bSchedule = true;
+                    }
+                }
+
+                if(bSchedule)
+                    Schedule(std::move(queue));
+            }
+
+            //Drop the serial queue of a key that will not be used again, e.g. a
+            //disconnected client. Tasks already dispatched, and any dispatched
+            //later, still run in order - a queue in use is only dropped by the
+            //worker that empties it
+            void Forget(uint32_t nKey)
+            {
+                std::scoped_lock lock(m_muxQueues);
+                auto it = m_mapQueues.find(nKey);
+                if(it == m_mapQueues.end())
+                    return;
+
+                std::scoped_lock lockQueue(it->second->mux);
+                if(it->second->bScheduled)
+                    it->second->bRetired = true;
+                else
+                    m_mapQueues.erase(it);
+            }
+
+            //Block until every task dispatched so far has run. Not from a worker
+            void WaitIdle()
+            {
+                std::unique_lock<std::mutex> lock(m_muxSignal);
+                m_cvIdle.wait(lock, [this]() { return m_nPending == 0; });
+            }
+
+            //Same, but give up at tDeadline. Returns true if the pool went idle
+            bool WaitIdleUntil(std::chrono::steady_clock::time_point tDeadline)
+            {
+                std::unique_lock<std::mutex> lock(m_muxSignal);
+                return m_cvIdle.wait_until(lock, tDeadline, [this]() { return m_nPending == 0; });
+            }
+
+            //Start no further tasks and block until the ones running have
+            //finished. Dispatch still queues, nothing runs until Resume()
+            void Pause()
+            {
+                std::unique_lock<std::mutex> lock(m_muxSignal);
+                m_bPaused = true;
+                m_cvIdle.wait(lock, [this]() { return m_nRunning == 0; });
+            }
+
+            void Resume()
+            {
+                {
+                    std::scoped_lock lock(m_muxSignal);
+                    m_bPaused = false;
+                }
+                m_cvWork.notify_all();
+            }
+
+            //True on the threads of any worker_pool
+            static bool OnWorkerThread()
+            {
+                return LocalWorker() >= 0;
+            }
+
+            //Finish what is queued and join the workers, safe to call twice
+            void Stop()
+            {
+                {
+                    std::scoped_lock lock(m_muxSignal);
+                    m_bRunning = false;
+                    m_bPaused = false;
+                }
+                m_cvWork.notify_all();
+
+                for(auto& t : m_vThreads)
+                {
+                    if(t.joinable())
+                        t.join();
+                }
+            }
+
+            size_t ThreadCount() const
+            {
+                return m_vWorkers.size();
+            }
+
+            //Queues a worker took from another worker's deque
+            uint64_t StolenCount() const
+            {
+                return m_nStolen;
+            }
+
+        private:
+            struct serial_queue
+            {
+                std::mutex mux;
+                std::deque<std::function<void()>> deqTasks;
+                //Sitting in a worker deque or being run right now
+                bool bScheduled = false;
+                //Forgotten while scheduled, dropped once it runs empty
+                bool bRetired = false;
+                uint32_t nKey = 0;
+            };
+
+            struct worker
+            {
+                std::mutex mux;
+                std::deque<std::shared_ptr<serial_queue>> deqReady;
+            };
+
+            //Index of the worker running on this thread, -1 elsewhere
+            static int& LocalWorker()
+            {
+                thread_local int nIndex = -1;
+                return nIndex;
+            }
+
+            //A worker keeps what it schedules itself, anything else is spread round robin
+            void Schedule(std::shared_ptr<serial_queue> queue)
+            {
+                int nLocal = LocalWorker();
+                size_t nWorker = nLocal >= 0 ? size_t(nLocal) : m_nNextWorker++ % m_vWorkers.size();
+
+                //Counted before it is visible, a worker that takes it straight
+                //away must not see the count go below zero
+                {
+                    std::scoped_lock lock(m_muxSignal);
+                    m_nReady++;
+                }
+
+                {
+                    std::scoped_lock lock(m_vWorkers[nWorker]->mux);
+                    m_vWorkers[nWorker]->deqReady.push_back(std::move(queue));
+                }
+                m_cvWork.notify_one();
+            }
+
+            //Own deque from the back, it is the most recently touched
+            std::shared_ptr<serial_queue> PopLocal(size_t nWorker)
+            {
+                auto& w = *m_vWorkers[nWorker];
+                std::scoped_lock lock(w.mux);
+                if(w.deqReady.empty())
+                    return nullptr;
+
+                auto queue = std::move(w.deqReady.back());
+                w.deqReady.pop_back();
+                return queue;
+            }
+
+            //Other deques from the front, away from their owner
+            std::shared_ptr<serial_queue> Steal(size_t nWorker)
+            {
+                for(size_t i = 1; i < m_vWorkers.size(); i++)
+                {
+                    auto& w = *m_vWorkers[(nWorker + i) % m_vWorkers.size()];
+                    std::unique_lock<std::mutex> lock(w.mux, std::try_to_lock);
+                    if(!lock || w.deqReady.empty())
+                        continue;
+
+                    auto queue = std::move(w.deqReady.front());
+                    w.deqReady.pop_front();
+                    m_nStolen++;
+                    return queue;
+                }
+                return nullptr;
+            }
+
+            void WorkerLoop(size_t nWorker)
+            {
+                LocalWorker() = int(nWorker);
+
+                while(true)
+                {
+                    std::shared_ptr<serial_queue> queue;
+                    if(!m_bPaused)
+                    {
+                        queue = PopLocal(nWorker);
+                        if(!queue)
+                            queue = Steal(nWorker);
+                    }
+
+                    if(queue)
+                    {
+                        {
+                            std::scoped_lock lock(m_muxSignal);
+                            m_nReady--;
+                        }
+                        RunQueue(queue);
+                        continue;
+                    }
+
+                    std::unique_lock<std::mutex> lock(m_muxSignal);
+                    m_cvWork.wait(lock, [this]() { return (m_nReady > 0 && !m_bPaused) || !m_bRunning; });
+                    if(m_nReady == 0 && !m_bRunning)
+                        return;
+                }
+            }
+
+            //Run a bounded number of tasks, then put the queue back so one busy
+            //connection cannot hold a worker forever
+            void RunQueue(const std::shared_ptr<serial_queue>& queue)
+            {
+                for(size_t n = 0; n < nTasksPerTurn; n++)
+                {
+                    //Counted as running before the pause is checked, so Pause()
+                    //either waits for this task or this task sees the pause
+                    m_nRunning++;
+                    if(m_bPaused)
+                    {
+                        EndRun();
+                        break;
+                    }
+
+                    std::function<void()> task;
+                    bool bRetired = false;
+                    {
+                        std::scoped_lock lock(queue->mux);
+                        if(queue->deqTasks.empty())
+                        {
+                            queue->bScheduled = false;
+                            bRetired = queue->bRetired;
+                        }
+                        else
+                        {
+                            task = std::move(queue->deqTasks.front());
+                            queue->deqTasks.pop_front();
+                        }
+                    }
+
+                    if(!task)
+                    {
+                        EndRun();
+                        if(bRetired)
+                            DropRetired(queue);
+                        return;
+                    }
+
+                    RunTask(task);
+                    EndRun();
+
+                    if(--m_nPending == 0)
+                    {
+                        std::scoped_lock lock(m_muxSignal);
+                        m_cvIdle.notify_all();
+                    }
+                }
+
+                bool bIdle = false, bRetired = false;
+                {
+                    std::scoped_lock lock(queue->mux);
+                    if(queue->deqTasks.empty())
+                    {
+                        queue->bScheduled = false;
+                        bIdle = true;
+                        bRetired = queue->bRetired;
+                    }
+                }
+
+                if(bIdle)
+                {
+                    if(bRetired)
+                        DropRetired(queue);
+                    return;
+                }
+                Schedule(queue);
+            }
+
+            //A forgotten queue that went idle leaves the map. Both locks, in the
+            //order Dispatch() takes them - a task queued meanwhile keeps it
+            void DropRetired(const std::shared_ptr<serial_queue>& queue)
+            {
+                std::scoped_lock lock(m_muxQueues);
+                std::scoped_lock lockQueue(queue->mux);
+                if(queue->bScheduled)
+                    return;
+
+                auto it = m_mapQueues.find(queue->nKey);
+                if(it != m_mapQueues.end() && it->second == queue)
+                    m_mapQueues.erase(it);
+            }
+
+            void EndRun()
+            {
+                if(--m_nRunning == 0 && m_bPaused)
+                {
+                    std::scoped_lock lock(m_muxSignal);
+                    m_cvIdle.notify_all();
+                }
+            }
+
+            static void RunTask(std::function<void()>& task)
+            {
+                try
+                {
+                    task();
+                }
+                catch(std::exception& e)
+                {
+                    Log(log_level::error, "Worker Task Failed", 0, std::error_code(), e.what());
+                }
+            }
+
+        private:
+            static constexpr size_t nTasksPerTurn = 32;
+
+            std::vector<std::unique_ptr<worker>> m_vWorkers;
+            std::vector<std::thread> m_vThreads;
+
+            std::mutex m_muxQueues;
+            std::unordered_map<uint32_t, std::shared_ptr<serial_queue>> m_mapQueues;
+
+            //Guards the sleep / idle conditions
+            std::mutex m_muxSignal;
+            std::condition_variable m_cvWork;
+            std::condition_variable m_cvIdle;
+            size_t m_nReady = 0;
+            std::atomic<bool> m_bRunning{true};
+            std::atomic<bool> m_bPaused{false};
+            //Tasks executing right now
+            std::atomic<size_t> m_nRunning{0};
+
+            std::atomic<size_t> m_nPending{0};
+            std::atomic<size_t> m_nNextWorker{0};
+            std::atomic<uint64_t> m_nStolen{0};
+        };
+    }
+}
+
+#endif // NET_WORKERS_H_INCLUDED
@@ -6,6 +6,8 @@
 #include "net_message.h"
 #include "net_server.h"
 #include "net_client.h"
+#include "net_snapshot.h"
+#include "net_cluster.h"
 
 #endif // OLC_NET_H_INCLUDED
 